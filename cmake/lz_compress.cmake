@@ -0,0 +1,8 @@
+find_package(Python3 REQUIRED COMPONENTS Interpreter)
+
+function(lz_compress TARGET INFILE OUTFILE)
+  add_custom_command(TARGET ${TARGET} POST_BUILD COMMAND
+    ${Python3_EXECUTABLE} ${CMAKE_SOURCE_DIR}/scripts/lz_compress.py
+      ${INFILE} ${OUTFILE}
+  )
+endfunction()
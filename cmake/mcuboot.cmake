@@ -10,3 +10,11 @@ function(mcuboot_image TARGET INFILE OUTFILE)
       ${INFILE} ${OUTFILE}
   )
 endfunction()
+
+# Creates a compressed patch that updates BASEFILE, a previous firmware_image.bin, to INFILE.
+function(mcuboot_patch TARGET BASEFILE INFILE OUTFILE)
+  add_custom_command(TARGET ${TARGET} POST_BUILD COMMAND
+    ${Python3_EXECUTABLE} ${CMAKE_SOURCE_DIR}/scripts/mcuboot_patch.py
+      ${BASEFILE} ${INFILE} ${OUTFILE}
+  )
+endfunction()
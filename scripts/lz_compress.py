@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+"""Compresses a firmware image for the MODBUS update.
+
+The format is decoded by src/lz_decoder.cc: Groups of one flag byte followed
+by eight items. A set flag bit (LSB first) marks a literal byte, a cleared bit
+a back reference of two bytes: distance - 1 and length - 3.
+"""
+
+import argparse
+
+WINDOW_SIZE = 256
+MIN_MATCH = 3
+MAX_MATCH = 255 + MIN_MATCH
+
+
+def find_match(data, pos):
+    """Returns (distance, length) of the longest match in the window."""
+    best = (0, 0)
+    end = min(len(data), pos + MAX_MATCH)
+    for distance in range(1, min(pos, WINDOW_SIZE) + 1):
+        length = 0
+        # Matches may overlap the current position (run length encoding).
+        while pos + length < end and \
+                data[pos + length - distance] == data[pos + length]:
+            length += 1
+        if length > best[1]:
+            best = (distance, length)
+            if length == end - pos:
+                break
+    return best
+
+
+def compress(data):
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        flags_index = len(out)
+        out.append(0)
+        for bit in range(8):
+            if pos >= len(data):
+                break
+            distance, length = find_match(data, pos)
+            if length >= MIN_MATCH:
+                out += bytes([distance - 1, length - MIN_MATCH])
+                pos += length
+            else:
+                out[flags_index] |= 1 << bit
+                out.append(data[pos])
+                pos += 1
+    return bytes(out)
+
+
+def decompress(data):
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        flags = data[pos]
+        pos += 1
+        for bit in range(8):
+            if pos >= len(data):
+                break
+            if flags & (1 << bit):
+                out.append(data[pos])
+                pos += 1
+            else:
+                distance = data[pos] + 1
+                length = data[pos + 1] + MIN_MATCH
+                pos += 2
+                for _ in range(length):
+                    out.append(out[-distance])
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('infile', type=argparse.FileType('rb'))
+    parser.add_argument('outfile', type=argparse.FileType('wb'))
+    args = parser.parse_args()
+
+    data = args.infile.read()
+    compressed = compress(data)
+    assert decompress(compressed) == data
+    args.outfile.write(compressed)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+"""Creates a patch to update from one signed image to another over MODBUS.
+
+The format is applied by src/delta_patch.cc: The magic "SSUP" and the SHA-256
+TLV of the base image followed by copy and insert operations. The patch is LZ
+compressed with lz_compress.py.
+"""
+
+import argparse
+import struct
+
+import lz_compress
+
+IMAGE_MAGIC = 0x96f3b83d
+IMAGE_TLV_INFO_MAGIC = 0x6907
+IMAGE_TLV_SHA256 = 0x10
+
+PATCH_MAGIC = b'SSUP'
+OP_COPY = 0
+OP_INSERT = 1
+
+MIN_COPY = 8  # Shorter copies do not save anything after compression.
+MAX_LENGTH = 0xFFFF
+GRAM = 4
+MAX_CANDIDATES = 64  # Limits the search time for repetitive data.
+
+
+def image_digest(image):
+    """Returns the SHA-256 TLV of a signed image."""
+    magic, _, hdr_size, _, img_size = struct.unpack_from('<IIHHI', image)
+    if magic != IMAGE_MAGIC:
+        raise ValueError('not an mcuboot image')
+
+    offset = hdr_size + img_size
+    magic, tlv_tot = struct.unpack_from('<HH', image, offset)
+    if magic != IMAGE_TLV_INFO_MAGIC:
+        raise ValueError('image has no TLVs')
+
+    end = offset + tlv_tot
+    offset += 4
+    while offset + 4 <= end:
+        tlv_type, tlv_len = struct.unpack_from('<BxH', image, offset)
+        offset += 4
+        if tlv_type == IMAGE_TLV_SHA256:
+            return image[offset:offset + tlv_len]
+        offset += tlv_len
+    raise ValueError('image has no SHA-256 TLV')
+
+
+def diff(base, image):
+    """Yields (offset, length) copies from base and bytes inserts."""
+    index = {}
+    for pos in range(len(base) - GRAM + 1):
+        index.setdefault(base[pos:pos + GRAM], []).append(pos)
+
+    pos = 0
+    insert = bytearray()
+    while pos < len(image):
+        best = (0, 0)
+        for start in index.get(image[pos:pos + GRAM], [])[-MAX_CANDIDATES:]:
+            length = 0
+            while (pos + length < len(image) and start + length < len(base)
+                   and length < MAX_LENGTH
+                   and base[start + length] == image[pos + length]):
+                length += 1
+            if length > best[1]:
+                best = (start, length)
+
+        if best[1] >= MIN_COPY:
+            if insert:
+                yield bytes(insert)
+                insert = bytearray()
+            yield best
+            pos += best[1]
+        else:
+            insert.append(image[pos])
+            pos += 1
+            if len(insert) == MAX_LENGTH:
+                yield bytes(insert)
+                insert = bytearray()
+    if insert:
+        yield bytes(insert)
+
+
+def create_patch(base, image):
+    if len(base) > MAX_LENGTH:
+        raise ValueError('base image too large')
+
+    patch = bytearray(PATCH_MAGIC + image_digest(base))
+    for op in diff(base, image):
+        if isinstance(op, bytes):
+            patch += struct.pack('<BH', OP_INSERT, len(op)) + op
+        else:
+            patch += struct.pack('<BHH', OP_COPY, *op)
+    return bytes(patch)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('base', type=argparse.FileType('rb'),
+                        help='signed image running on the device')
+    parser.add_argument('infile', type=argparse.FileType('rb'),
+                        help='signed update image')
+    parser.add_argument('outfile', type=argparse.FileType('wb'))
+    args = parser.parse_args()
+
+    base = args.base.read()
+    image = args.infile.read()
+    patch = create_patch(base, image)
+    args.outfile.write(lz_compress.compress(patch))
+
+
+if __name__ == '__main__':
+    main()
@@ -5,12 +5,15 @@
 #include <assert.h>
 #include <stddef.h>
 #include <string.h>
+#include <algorithm>
 #include <array>
 
 #include "chip.h"
 
-// Number of flash areas, always 3 with MCBboot: 
-constexpr int kNumFlashAreas = 3;
+#include "boot_stats.h"
+
+// Number of flash areas, always 3 with MCBboot plus the firmware settings.
+constexpr int kNumFlashAreas = 4;
 
 // Smallest erasable flash block size.
 constexpr uint32_t kPageSize = 1024;
@@ -18,6 +21,13 @@ constexpr uint32_t kPageSize = 1024;
 // Minimum aligment and size of a flash write operation.
 constexpr uint8_t kWriteSize = 4;
 
+// Smallest block the IAP programs at once. Larger blocks must be a power of
+// two multiple up to kPageSize.
+constexpr uint32_t kProgramSize = 64;
+
+// The IAP only programs from RAM.
+constexpr uint32_t kRamStart = 0x10000000;
+
 // Provided by flash_map.ld linker script in src/config/linker folder.
 extern uint32_t _flash_slot0[];
 extern uint32_t _flash_slot0_length[];
@@ -25,6 +35,10 @@ extern uint32_t _flash_slot1[];
 extern uint32_t _flash_slot1_length[];
 extern uint32_t _flash_scratch[];
 extern uint32_t _flash_scratch_length[];
+extern uint32_t _flash_settings[];
+extern uint32_t _flash_settings_length[];
+
+BootStats *flash_stats = nullptr;
 
 constexpr struct flash_area areas[kNumFlashAreas] = {
     {0, 0, 0, reinterpret_cast<uint32_t>(_flash_slot0),
@@ -33,6 +47,8 @@ constexpr struct flash_area areas[kNumFlashAreas] = {
      reinterpret_cast<uint32_t>(_flash_slot1_length)},
     {2, 0, 0, reinterpret_cast<uint32_t>(_flash_scratch),
      reinterpret_cast<uint32_t>(_flash_scratch_length)},
+    {3, 0, 0, reinterpret_cast<uint32_t>(_flash_settings),
+     reinterpret_cast<uint32_t>(_flash_settings_length)},
 };
 
 int flash_area_open(uint8_t id, const struct flash_area **area) {
@@ -48,54 +64,115 @@ int flash_area_read(const struct flash_area *area, uint32_t off, void *dst,
   return 0;
 }
 
-int flash_area_write(const struct flash_area *area, uint32_t off,
-                     const void *src, uint32_t len) {
-  uint8_t rc;
+namespace {
 
-  assert(area && src && len > 0 && (len % 4 == 0));
+// The bootloader runs MRT channel 1 as free running down counter while it
+// measures.
+uint32_t FlashTimer() {
+  return flash_stats != nullptr ? Chip_MRT_GetTimer(LPC_MRT_CH1) : 0;
+}
+
+// Swap areas only, the settings are not touched by mcuboot.
+bool IsSwapArea(const struct flash_area *area) {
+  return flash_stats != nullptr && area->fa_id < BootStats::kNumAreas;
+}
 
-  uint32_t addr = (area->fa_off + off);
+// Largest block that the IAP can program at once starting at the page aligned
+// address with len bytes available.
+uint32_t ProgramBlockSize(uint32_t addr, uint32_t len) {
+  uint32_t size = kPageSize;
+  while (size > kProgramSize && (size > len || addr % size != 0)) {
+    size /= 2;
+  }
+  return size;
+}
+
+int Program(uint32_t addr, const void *src, uint32_t len) {
   uint32_t sector = addr / kPageSize;
-  uint32_t sector_addr = sector * kPageSize;
-  uint32_t sector_offset = addr - sector_addr;
-  if (sector_offset + len > kPageSize) {
+  if (Chip_IAP_PreSectorForReadWrite(sector, sector) != IAP_CMD_SUCCESS) {
     return -1;
   }
 
-  rc = Chip_IAP_PreSectorForReadWrite(sector, sector);
-  assert(rc == IAP_CMD_SUCCESS);
+  uint8_t rc = Chip_IAP_CopyRamToFlash(
+      addr, const_cast<uint32_t *>(static_cast<const uint32_t *>(src)), len);
+  return (rc == IAP_CMD_SUCCESS) ? 0 : -1;
+}
+
+}  // namespace
 
-  uint8_t sector_buf[kPageSize];
+int flash_area_write(const struct flash_area *area, uint32_t off,
+                     const void *src, uint32_t len) {
+  assert(area && src && len > 0 && (len % kWriteSize == 0));
 
-  // Get previous data at this location so it won’t be overwritten.
-  if (len < kPageSize) {
-    memcpy(sector_buf, (void *)sector_addr, kPageSize);
+  if (off + len > area->fa_size) {
+    return -1;
   }
-  memcpy(&sector_buf[sector_offset], src, len);
 
-  rc = Chip_IAP_CopyRamToFlash(sector_addr, (uint32_t *)&sector_buf[0],
-                               kPageSize);
-  assert(rc == IAP_CMD_SUCCESS);
+  uint32_t start = FlashTimer();
+  uint32_t addr = area->fa_off + off;
+  const uint8_t *data = static_cast<const uint8_t *>(src);
+  bool direct = reinterpret_cast<uint32_t>(src) >= kRamStart &&
+                reinterpret_cast<uint32_t>(src) % kWriteSize == 0;
+
+  while (len > 0) {
+    uint32_t page_offset = addr % kProgramSize;
+    uint32_t n;
+    int rc;
+
+    if (direct && page_offset == 0 && len >= kProgramSize) {
+      // Program whole pages straight from the source buffer.
+      n = ProgramBlockSize(addr, len);
+      rc = Program(addr, data, n);
+    } else {
+      // Merge partial pages with the current flash contents.
+      uint32_t page_buf[kProgramSize / sizeof(uint32_t)];
+      uint32_t page_addr = addr - page_offset;
+      n = std::min(len, kProgramSize - page_offset);
+      memcpy(page_buf, reinterpret_cast<void *>(page_addr), kProgramSize);
+      memcpy(reinterpret_cast<uint8_t *>(page_buf) + page_offset, data, n);
+      rc = Program(page_addr, page_buf, kProgramSize);
+    }
+
+    if (rc != 0) {
+      return rc;
+    }
+
+    addr += n;
+    data += n;
+    len -= n;
+  }
 
+  if (IsSwapArea(area)) {
+    flash_stats->program_us[area->fa_id] += start - FlashTimer();
+  }
   return 0;
 }
 
 int flash_area_erase(const struct flash_area *area, uint32_t off,
                      uint32_t len) {
   uint8_t rc;
-  assert(len == kPageSize);
+  assert(len > 0 && len % kPageSize == 0 && off + len <= area->fa_size);
 
   uint32_t sector_addr = area->fa_off + off;
   assert(sector_addr % kPageSize == 0);
 
+  uint32_t start = FlashTimer();
   uint32_t sector_start = sector_addr / kPageSize;
   uint32_t sector_stop = sector_start + len / kPageSize - 1;
 
+  // Callers track erased sectors, a failed erase must not pass unnoticed.
   rc = Chip_IAP_PreSectorForReadWrite(sector_start, sector_stop);
-  assert(rc == IAP_CMD_SUCCESS);
+  if (rc == IAP_CMD_SUCCESS) {
+    rc = Chip_IAP_EraseSector(sector_start, sector_stop);
+  }
+  if (rc != IAP_CMD_SUCCESS) {
+    return -1;
+  }
 
-  rc = Chip_IAP_EraseSector(sector_start, sector_stop);
-  assert(rc == IAP_CMD_SUCCESS);
+  if (IsSwapArea(area)) {
+    flash_stats->erase_us[area->fa_id] += start - FlashTimer();
+    flash_stats->erases[area->fa_id] += len / kPageSize;
+  }
 
   return 0;
 }
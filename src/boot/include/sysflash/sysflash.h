@@ -7,4 +7,7 @@
 #define FLASH_AREA_IMAGE_1 2
 #define FLASH_AREA_IMAGE_SCRATCH 3
 
+// Not used by mcuboot: Persistent firmware settings.
+#define FLASH_AREA_SETTINGS 4
+
 #endif  // CONFIG_SYSFLASH_SYSFLASH_H_ */
@@ -0,0 +1,123 @@
+// Copyright (c) 2018 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "bootutil/bootutil.h"
+#include "bootutil/image.h"
+#include "chip.h"
+
+#include "boot/recovery.h"
+#include "boot_stats.h"
+
+// Required by the vendor chip library.
+extern "C" {
+
+const uint32_t OscRateIn = 0;  // External oscillator not used.
+const uint32_t ExtRateIn = 0;  // External clock input not used.
+
+}
+
+namespace {
+
+struct arm_vector_table {
+  uint32_t msp;
+  uint32_t reset;
+};
+
+// Pulling this pin to ground during reset enters the recovery mode even when
+// the image is valid.
+constexpr uint8_t kRecoveryStrapPin = 1;
+
+bool RecoveryStrapped() {
+  Chip_Clock_EnablePeriphClock(SYSCTL_CLOCK_IOCON);
+  Chip_IOCON_PinSetMode(LPC_IOCON, IOCON_PIO1, PIN_MODE_PULLUP);
+  Chip_Clock_DisablePeriphClock(SYSCTL_CLOCK_IOCON);
+
+  Chip_Clock_EnablePeriphClock(SYSCTL_CLOCK_GPIO);
+  bool strapped = !Chip_GPIO_GetPinState(LPC_GPIO_PORT, 0, kRecoveryStrapPin);
+  Chip_Clock_DisablePeriphClock(SYSCTL_CLOCK_GPIO);
+
+  return strapped;
+}
+
+// Same clock configuration as the firmware: 30MHz from the PLL.
+void UsePll() {
+  Chip_Clock_SetSystemPLLSource(SYSCTL_PLLCLKSRC_IRC);
+  Chip_Clock_SetupSystemPLL(4, 1);
+  Chip_SYSCTL_PowerUp(SYSCTL_SLPWAKE_SYSPLL_PD);
+  while (!Chip_Clock_IsSystemPLLLocked())
+    ;
+
+  Chip_FMC_SetFLASHAccess(FLASHTIM_30MHZ_CPU);
+  Chip_Clock_SetSysClockDiv(2);
+  Chip_Clock_SetMainClockSource(SYSCTL_MAINCLKSRC_PLLOUT);
+
+  // Update CMSIS clock frequency variable which is used in iap.c
+  SystemCoreClock = 30'000'000;
+}
+
+// Back to the reset configuration.
+void UseIrc() {
+  Chip_Clock_SetMainClockSource(SYSCTL_MAINCLKSRC_IRC);
+  Chip_Clock_SetSysClockDiv(1);
+  Chip_FMC_SetFLASHAccess(FLASHTIM_20MHZ_CPU);
+  Chip_SYSCTL_PowerDown(SYSCTL_SLPWAKE_SYSPLL_PD);
+
+  SystemCoreClock = 12'000'000;
+}
+
+// Runs mcuboot and records its duration and flash operations. Hashing and
+// swapping run from the PLL.
+int BootTimed(struct boot_rsp *rsp) {
+  boot_stats = {};
+  boot_stats.swap_type = boot_swap_type();
+
+  UsePll();
+
+  // Free running down counter for the whole boot and each flash operation.
+  Chip_MRT_Init();
+  Chip_MRT_SetMode(LPC_MRT_CH1, MRT_MODE_REPEAT);
+  Chip_MRT_SetInterval(LPC_MRT_CH1, MRT_INTVAL_IVALUE | MRT_INTVAL_LOAD);
+  flash_stats = &boot_stats;
+
+  uint32_t start = Chip_MRT_GetTimer(LPC_MRT_CH1);
+  int rc = boot_go(rsp);
+  boot_stats.boot_us = start - Chip_MRT_GetTimer(LPC_MRT_CH1);
+
+  flash_stats = nullptr;
+  Chip_MRT_DeInit();
+
+  // Convert from ticks.
+  uint32_t ticks_per_us = Chip_Clock_GetSystemClockRate() / 1'000'000;
+  boot_stats.boot_us /= ticks_per_us;
+  for (int i = 0; i < BootStats::kNumAreas; i++) {
+    boot_stats.erase_us[i] /= ticks_per_us;
+    boot_stats.program_us[i] /= ticks_per_us;
+  }
+  boot_stats.magic = BootStats::kMagic;
+
+  UseIrc();
+
+  return rc;
+}
+
+}  // namespace
+
+int main() {
+  struct boot_rsp rsp;
+
+  if (!RecoveryStrapped() && BootTimed(&rsp) == 0) {
+    auto vt = reinterpret_cast<struct arm_vector_table *>(
+        rsp.br_image_off + rsp.br_hdr->ih_hdr_size);
+
+    // Load new stack pointer.
+    __set_MSP(vt->msp);
+
+    // Jump to actual reset handler.
+    reinterpret_cast<void (*)()>(vt->reset)();
+  }
+
+  // No valid image: Wait for one over MODBUS.
+  RecoveryRun();
+
+  // Not reached.
+  return 0;
+}
@@ -0,0 +1,263 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "boot/recovery.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "bootutil/bootutil.h"
+#include "chip.h"
+#include "flash_map_backend/flash_map_backend.h"
+#include "sysflash/sysflash.h"
+
+#include "bsp/modbus_serial.h"
+#include "config.h"
+#include "modbus/rtu_protocol.h"
+#include "modbus/slave.h"
+
+// Provided by memory.ld.
+extern uint32_t _image_max_size[];
+
+constexpr uint16_t RecoveryData::kRecoveryRegister;
+constexpr uint16_t RecoveryData::kRecoveryMagic;
+constexpr uint16_t RecoveryData::kCommandRegister;
+constexpr uint16_t RecoveryData::kImageRegister;
+constexpr uint16_t RecoveryData::kImageRegisterEnd;
+constexpr uint16_t RecoveryData::kSlot1File;
+constexpr uint16_t RecoveryData::kSlot0File;
+constexpr size_t RecoveryData::kPageSize;
+constexpr size_t RecoveryData::kSectorSize;
+constexpr size_t RecoveryData::kNoPage;
+
+modbus::ExceptionCode RecoveryData::ReadRegister(uint16_t address,
+                                                 uint16_t *data_out) {
+  if (address != kRecoveryRegister) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  *data_out = kRecoveryMagic;
+  return modbus::ExceptionCode::kOk;
+}
+
+modbus::ExceptionCode RecoveryData::ReadDiscreteInput(uint16_t address,
+                                                      bool *data_out) {
+  return modbus::ExceptionCode::kIllegalDataAddress;
+}
+
+modbus::ExceptionCode RecoveryData::WriteRegister(uint16_t address,
+                                                  uint16_t data) {
+  if (address >= kImageRegister && address < kImageRegisterEnd) {
+    return WriteFileRecord(kSlot1File, address - kImageRegister, data);
+  }
+
+  if (address != kCommandRegister) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  bool ok = Flush();
+  switch (data) {
+    case Command::kPrepare:
+      std::fill(std::begin(erased_sectors_), std::end(erased_sectors_), 0);
+      break;
+
+    case Command::kSetPending: {
+      // The trailer in the last sector must not contain data of a previous
+      // update.
+      const struct flash_area *fa;
+      ok = ok && flash_area_open(FLASH_AREA_IMAGE_1, &fa) == 0;
+      if (ok) {
+        ok = EraseSector(FLASH_AREA_IMAGE_1, fa, fa->fa_size - kSectorSize);
+        flash_area_close(fa);
+      }
+
+      // There may be no working image to revert to.
+      ok = ok && boot_set_pending(1) == 0;
+    } break;
+
+    case Command::kReset:
+      reset_requested_ = true;
+      break;
+
+    default:
+      return modbus::ExceptionCode::kIllegalDataValue;
+  }
+
+  return ok ? modbus::ExceptionCode::kOk
+            : modbus::ExceptionCode::kSlaveDeviceFailure;
+}
+
+modbus::ExceptionCode RecoveryData::ReadFileRecord(uint16_t file,
+                                                   uint16_t record,
+                                                   uint16_t *data_out) {
+  const struct flash_area *fa;
+  uint8_t area = FileArea(file);
+  if (area == 0 || flash_area_open(area, &fa) != 0) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  uint8_t data[2];
+  size_t offset = 2 * record;
+  bool ok = offset + sizeof(data) <= fa->fa_size &&
+            flash_area_read(fa, offset, data, sizeof(data)) == 0;
+  flash_area_close(fa);
+
+  if (!ok) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  *data_out = data[0] << 8 | data[1];
+  return modbus::ExceptionCode::kOk;
+}
+
+modbus::ExceptionCode RecoveryData::WriteFileRecord(uint16_t file,
+                                                    uint16_t record,
+                                                    uint16_t data) {
+  // Images end before the settings sector in slot 0, see memory.ld.
+  uint8_t area = FileArea(file);
+  size_t offset = 2 * record;
+  if (area == 0 || offset >= reinterpret_cast<size_t>(_image_max_size)) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  // Program the collected page when the data continues elsewhere.
+  size_t page_offset = offset - offset % kPageSize;
+  if (area != page_area_ || page_offset != page_offset_) {
+    if (!Flush()) {
+      return modbus::ExceptionCode::kSlaveDeviceFailure;
+    }
+    page_area_ = area;
+    page_offset_ = page_offset;
+    page_words_ = 0;
+    std::fill(std::begin(page_), std::end(page_), 0xFF);
+  }
+
+  size_t word = (offset % kPageSize) / 2;
+  page_[2 * word] = data >> 8;
+  page_[2 * word + 1] = data & 0xFF;
+  page_words_ |= 1u << word;
+
+  if (page_words_ == UINT32_MAX && !Flush()) {
+    return modbus::ExceptionCode::kSlaveDeviceFailure;
+  }
+
+  return modbus::ExceptionCode::kOk;
+}
+
+uint8_t RecoveryData::FileArea(uint16_t file) {
+  if (file == kSlot0File) {
+    return FLASH_AREA_IMAGE_0;
+  } else if (file == kSlot1File) {
+    return FLASH_AREA_IMAGE_1;
+  }
+  return 0;
+}
+
+bool RecoveryData::Flush() {
+  if (page_offset_ == kNoPage) {
+    return true;
+  }
+
+  const struct flash_area *fa;
+  if (flash_area_open(page_area_, &fa) != 0) {
+    return false;
+  }
+
+  bool ok = EraseSector(page_area_, fa, page_offset_) &&
+            flash_area_write(fa, page_offset_, page_, kPageSize) == 0;
+  flash_area_close(fa);
+
+  page_offset_ = kNoPage;
+  return ok;
+}
+
+bool RecoveryData::EraseSector(uint8_t area, const struct flash_area *fa,
+                               size_t offset) {
+  uint32_t &erased = erased_sectors_[area == FLASH_AREA_IMAGE_1];
+  uint32_t mask = 1u << (offset / kSectorSize);
+  if (erased & mask) {
+    return true;
+  }
+
+  if (area == FLASH_AREA_IMAGE_0) {
+    // Like kSetPending does for slot 1: The trailer of a previous swap must
+    // not apply to the new image, even when the image does not reach it.
+    size_t trailer = fa->fa_size - kSectorSize;
+    uint32_t trailer_mask = 1u << (trailer / kSectorSize);
+    if (mask != trailer_mask && !(erased & trailer_mask)) {
+      if (flash_area_erase(fa, trailer, kSectorSize) != 0) {
+        return false;
+      }
+      erased |= trailer_mask;
+    }
+  }
+
+  if (flash_area_erase(fa, offset - offset % kSectorSize, kSectorSize) != 0) {
+    return false;
+  }
+  erased |= mask;
+  return true;
+}
+
+namespace {
+
+ModbusSerial modbus_serial(LPC_USART0, LPC_MRT_CH0);
+modbus::RtuProtocol modbus_rtu(modbus_serial);
+RecoveryData recovery_data;
+modbus::Slave modbus_slave(recovery_data);
+
+// Same pins as the firmware.
+void SetupPins() {
+  Chip_Clock_EnablePeriphClock(SYSCTL_CLOCK_IOCON);
+
+  // Disable pull-up on DE for the RS485 transceiver.
+  // An external pull-down resistor is used instead.
+  Chip_IOCON_PinSetMode(LPC_IOCON, IOCON_PIO0, PIN_MODE_INACTIVE);
+
+  Chip_Clock_DisablePeriphClock(SYSCTL_CLOCK_IOCON);
+
+  Chip_SWM_Init();
+  Chip_SWM_MovablePinAssign(SWM_U0_TXD_O, 8);
+  Chip_SWM_MovablePinAssign(SWM_U0_RXD_I, 14);
+  Chip_SWM_MovablePinAssign(SWM_U0_RTS_O, 0);
+  Chip_SWM_Deinit();
+}
+
+}  // namespace
+
+void RecoveryRun() {
+  SetupPins();
+
+  // Runs from the internal RC oscillator like the rest of the bootloader.
+  Chip_MRT_Init();
+  modbus_serial.Init(CONFIG_BAUDRATE);
+  modbus_serial.set_modbus_rtu(&modbus_rtu);
+  modbus_slave.set_address(CONFIG_SENSOR_ID);
+
+  NVIC_EnableIRQ(UART0_IRQn);
+  NVIC_EnableIRQ(MRT_IRQn);
+  modbus_serial.Enable();
+
+  for (;;) {
+    __disable_irq();
+
+    auto req = modbus_rtu.ReadFrame();
+    if (req != nullptr) {
+      modbus::Buffer resp;
+      if (modbus_slave.Execute(req, &resp)) {
+        modbus_rtu.WriteFrame(&resp);
+      }
+    } else if (recovery_data.reset_requested() && !modbus_serial.tx_active()) {
+      NVIC_SystemReset();
+    } else {
+      // Pending interrupts wake up the core even though they are disabled.
+      __WFI();
+    }
+
+    __enable_irq();
+  }
+}
+
+// Interrupt Service Routines
+void MRT_Handler() { modbus_serial.TimerIsr(); }
+
+void UART0_Handler() { modbus_serial.UartIsr(); }
@@ -0,0 +1,86 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef BOOT_RECOVERY_H_
+#define BOOT_RECOVERY_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "modbus/data_interface.h"
+
+struct flash_area;
+
+// Data of the MODBUS slave in the bootloader. Writes an image to one of the
+// slots when the firmware cannot be started.
+//
+// The update commands and the image registers of the firmware update
+// (0x8000 + word offset into slot 1) work the same way so that the same tools
+// recover a device. File records address the slots directly.
+class RecoveryData final : public modbus::DataInterface {
+ public:
+  // Reads kRecoveryMagic so that masters detect the recovery mode. The
+  // firmware answers with an exception: 0x7FFC is unused in its update
+  // registers (0x8000 + ModbusDataFwUpdate register).
+  static constexpr uint16_t kRecoveryRegister = 0xFFFC;
+  static constexpr uint16_t kRecoveryMagic = 0x5245;  // "RE"
+  static constexpr uint16_t kCommandRegister = 0xFFFF;
+
+  static constexpr uint16_t kImageRegister = 0x8000;
+  static constexpr uint16_t kImageRegisterEnd = 0xC000;
+
+  // The firmware update uses file 1 for slot 1 as well.
+  static constexpr uint16_t kSlot1File = 1;
+  static constexpr uint16_t kSlot0File = 3;
+
+  enum Command : uint16_t {
+    kPrepare = 0,     // Forget which sectors were erased.
+    kSetPending = 1,  // Install slot 1 permanently after the next reset.
+    kReset = 0xFF,    // Leave the recovery mode after the response.
+  };
+
+  void Start(modbus::FunctionCode fn_code, bool broadcast) override {}
+  void Complete() override {}
+
+  modbus::ExceptionCode ReadRegister(uint16_t address,
+                                     uint16_t *data_out) override;
+  modbus::ExceptionCode ReadDiscreteInput(uint16_t address,
+                                          bool *data_out) override;
+  modbus::ExceptionCode WriteRegister(uint16_t address, uint16_t data) override;
+  modbus::ExceptionCode ReadFileRecord(uint16_t file, uint16_t record,
+                                       uint16_t *data_out) override;
+  modbus::ExceptionCode WriteFileRecord(uint16_t file, uint16_t record,
+                                        uint16_t data) override;
+
+  bool reset_requested() const { return reset_requested_; }
+
+ private:
+  // Smallest block that is programmed at once.
+  static constexpr size_t kPageSize = 64;
+  static constexpr size_t kSectorSize = 1024;
+  static constexpr size_t kNoPage = SIZE_MAX;
+
+  // Flash area of the file or 0 when there is none.
+  static uint8_t FileArea(uint16_t file);
+
+  // Programs the page buffer. Missing words stay erased.
+  bool Flush();
+
+  // Erases the sector when it was not erased since the last kPrepare. The
+  // first erase in slot 0 erases its trailer sector as well.
+  bool EraseSector(uint8_t area, const struct flash_area *fa, size_t offset);
+
+  uint8_t page_area_ = 0;
+  size_t page_offset_ = kNoPage;
+  uint32_t page_words_ = 0;
+  alignas(4) uint8_t page_[kPageSize];
+
+  // One bitmap of erased sectors per slot.
+  uint32_t erased_sectors_[2] = {};
+
+  bool reset_requested_ = false;
+};
+
+// Runs the MODBUS slave with RecoveryData until a reset is requested.
+[[noreturn]] void RecoveryRun();
+
+#endif  // BOOT_RECOVERY_H_
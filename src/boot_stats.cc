@@ -0,0 +1,8 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "boot_stats.h"
+
+constexpr uint32_t BootStats::kMagic;
+
+// Same address in the bootloader and the firmware, see memory.ld.
+BootStats boot_stats __attribute__((section(".noinit")));
@@ -0,0 +1,36 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef BOOT_STATS_H_
+#define BOOT_STATS_H_
+
+#include <cstdint>
+
+// Timing of the last boot measured by the bootloader. Lives in a RAM region
+// that the startup code does not initialize so that the firmware can report
+// it. Only valid when magic equals kMagic.
+struct BootStats {
+  static constexpr uint32_t kMagic = 0x54534253;  // "SBST"
+
+  // Flash areas of the image swap.
+  enum Area : uint8_t {
+    kSlot0 = 0,
+    kSlot1,
+    kScratch,
+    kNumAreas,
+  };
+
+  uint32_t magic;
+  uint32_t swap_type;  // BOOT_SWAP_TYPE_* of mcuboot before the swap.
+  uint32_t boot_us;    // Validation and swap.
+  uint32_t erase_us[kNumAreas];
+  uint32_t program_us[kNumAreas];
+  uint16_t erases[kNumAreas];
+};
+
+extern BootStats boot_stats;
+
+// Accumulates the flash operations of the mcuboot flash backend while set.
+// Durations are in MRT ticks until the bootloader converts them.
+extern BootStats *flash_stats;
+
+#endif  // BOOT_STATS_H_
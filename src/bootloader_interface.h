@@ -17,6 +17,42 @@ class BootloaderInterface {
   // Returns true when successfull, false otherwise.
   virtual bool WriteImageData(size_t offset, uint8_t* data, size_t length) = 0;
 
+  // Largest image in bytes, including its TLVs. The rest of the update slot
+  // is reserved for the bootloader.
+  virtual size_t MaxImageSize() = 0;
+
+  // Reads back parts of the update slot.
+  // Returns false when the range exceeds the slot.
+  virtual bool ReadImageData(size_t offset, uint8_t* data, size_t length) = 0;
+
+  // Number of leading bytes of the update image that were hashed. The SHA-256
+  // advances in order over the written data, read back from flash.
+  virtual size_t HashedLength() = 0;
+
+  // Copies the SHA-256 of the image header and body, as computed by the
+  // bootloader, to digest (32 bytes).
+  // Returns false until all of it was written.
+  virtual bool ImageDigest(uint8_t* digest) = 0;
+
+  // Compares the digest with the SHA-256 TLV behind the image.
+  // Returns true when they match.
+  virtual bool VerifyUpdate() = 0;
+
+  // Computes the standard CRC-32 (as used by zlib) over a range of the update
+  // slot.
+  // Returns false when the range exceeds the slot.
+  virtual bool UpdateSlotCrc32(size_t offset, size_t length,
+                               uint32_t* crc) = 0;
+
+  // Reads parts of the running image.
+  // Returns false when the range exceeds the slot.
+  virtual bool ReadRunningImage(size_t offset, uint8_t* data,
+                                size_t length) = 0;
+
+  // Copies the SHA-256 TLV of the running image to digest (32 bytes).
+  // Returns false when the image has none.
+  virtual bool RunningImageDigest(uint8_t* digest) = 0;
+
   // Mark update image as ready so that the bootloader copies and uses it after
   // the next reset.
   virtual bool SetUpdatePending() = 0;
@@ -2,10 +2,28 @@
 
 #include "bsp/bootloader.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "bootutil/bootutil.h"
+#include "bootutil/image.h"
+#include "chip.h"
 #include "flash_map_backend/flash_map_backend.h"
 #include "sysflash/sysflash.h"
 
+// Provided by memory.ld: Images end before the settings sector.
+extern uint32_t _image_max_size[];
+
+namespace {
+
+// Smallest erasable unit of the flash.
+constexpr size_t kSectorSize = 1024;
+
+// Flash data is hashed in pieces of this size to limit the stack usage.
+constexpr size_t kHashReadSize = 64;
+
+}  // namespace
+
 bool Bootloader::PrepareUpdate() {
   const struct flash_area *fa;
   int rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
@@ -13,33 +31,281 @@ bool Bootloader::PrepareUpdate() {
     return false;
   }
 
-  rc = flash_area_erase(fa, 0, fa->fa_size);
+  // Limited by the size of the sector and chunk bitmaps.
+  bool ok = fa->fa_size <= kChunkSize * 32;
+  flash_area_close(fa);
+
+  // Defer erasing to the first write of each sector.
+  erased_sectors_ = 0;
+
+  written_chunks_ = 0;
+  tc_sha256_init(&sha_);
+  hashed_length_ = 0;
+  image_length_ = 0;
+  image_invalid_ = false;
+
+  return ok;
+}
+
+bool Bootloader::WriteImageData(size_t offset, uint8_t *data, size_t length) {
+  if (offset > MaxImageSize() || length > MaxImageSize() - offset) {
+    return false;
+  }
+
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  if (!EraseSectors(fa, offset, length)) {
+    flash_area_close(fa);
+    return false;
+  }
+
+  rc = flash_area_write(fa, offset, data, length);
   if (rc != 0) {
     flash_area_close(fa);
     return false;
   }
 
+  // Only completely written chunks count.
+  size_t first = (offset + kChunkSize - 1) / kChunkSize;
+  size_t end = (offset + length) / kChunkSize;
+  for (size_t chunk = first; chunk < end; chunk++) {
+    written_chunks_ |= 1u << chunk;
+  }
+  UpdateHash(fa);
+
   flash_area_close(fa);
   return true;
 }
 
-bool Bootloader::WriteImageData(size_t offset, uint8_t *data, size_t length) {
+size_t Bootloader::MaxImageSize() {
+  return reinterpret_cast<size_t>(_image_max_size);
+}
+
+bool Bootloader::ReadImageData(size_t offset, uint8_t *data, size_t length) {
   const struct flash_area *fa;
   int rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
   if (rc != 0) {
     return false;
   }
 
-  rc = flash_area_write(fa, offset, data, length);
+  bool ok = offset <= fa->fa_size && length <= fa->fa_size - offset &&
+            flash_area_read(fa, offset, data, length) == 0;
+  flash_area_close(fa);
+  return ok;
+}
+
+bool Bootloader::ImageDigest(uint8_t *digest) {
+  if (image_length_ == 0 || hashed_length_ < image_length_) {
+    return false;
+  }
+
+  memcpy(digest, digest_, sizeof(digest_));
+  return true;
+}
+
+bool Bootloader::VerifyUpdate() {
+  if (image_length_ == 0 || hashed_length_ < image_length_) {
+    return false;
+  }
+
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
   if (rc != 0) {
-    flash_area_close(fa);
     return false;
   }
 
+  // Data of a previous image may remain in unwritten parts of the slot.
+  uint8_t expected[sizeof(digest_)];
+  size_t end;
+  bool match = ReadHashTlv(fa, image_length_, expected, &end) &&
+               end <= MaxImageSize() &&
+               IsWritten(image_length_, end - image_length_) &&
+               memcmp(expected, digest_, sizeof(digest_)) == 0;
+
   flash_area_close(fa);
-  return true;
+  return match;
 }
 
-bool Bootloader::SetUpdatePending() { return boot_set_pending(0) == 0; }
+bool Bootloader::UpdateSlotCrc32(size_t offset, size_t length,
+                                 uint32_t *crc) {
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  bool ok = offset <= fa->fa_size && length <= fa->fa_size - offset;
+  if (ok) {
+    // The flash is memory mapped. The CRC engine takes one byte per write.
+    auto data = reinterpret_cast<const uint8_t *>(fa->fa_off + offset);
+    Chip_CRC_Init();
+    Chip_CRC_UseCRC32();
+    for (size_t i = 0; i < length; i++) {
+      Chip_CRC_Write8(data[i]);
+    }
+    *crc = Chip_CRC_Sum();
+    Chip_CRC_Deinit();
+  }
+
+  flash_area_close(fa);
+  return ok;
+}
+
+bool Bootloader::ReadRunningImage(size_t offset, uint8_t *data,
+                                  size_t length) {
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_IMAGE_0, &fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  bool ok = offset <= fa->fa_size && length <= fa->fa_size - offset;
+  if (ok) {
+    // The flash is memory mapped.
+    memcpy(data, reinterpret_cast<const uint8_t *>(fa->fa_off + offset),
+           length);
+  }
+
+  flash_area_close(fa);
+  return ok;
+}
+
+bool Bootloader::RunningImageDigest(uint8_t *digest) {
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_IMAGE_0, &fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  // The bootloader validated the running image so the header can be trusted.
+  struct image_header hdr;
+  size_t end;
+  bool ok = flash_area_read(fa, 0, &hdr, sizeof(hdr)) == 0 &&
+            hdr.ih_magic == IMAGE_MAGIC &&
+            ReadHashTlv(fa, hdr.ih_hdr_size + hdr.ih_img_size, digest, &end);
+  flash_area_close(fa);
+  return ok;
+}
+
+bool Bootloader::SetUpdatePending() {
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  // The image trailer in the last sector must not contain data of a previous
+  // update when the image does not reach into it.
+  bool ok = EraseSectors(fa, fa->fa_size - kSectorSize, kSectorSize);
+  flash_area_close(fa);
+
+  return ok && boot_set_pending(0) == 0;
+}
 
 bool Bootloader::SetUpdateConfirmed() { return boot_set_confirmed() == 0; }
+
+bool Bootloader::EraseSectors(const struct flash_area *fa, size_t offset,
+                              size_t length) {
+  if (length == 0 || offset + length > fa->fa_size) {
+    return false;
+  }
+
+  size_t last = (offset + length - 1) / kSectorSize;
+  for (size_t sector = offset / kSectorSize; sector <= last; sector++) {
+    uint32_t mask = 1u << sector;
+    if (erased_sectors_ & mask) {
+      continue;
+    }
+
+    if (flash_area_erase(fa, sector * kSectorSize, kSectorSize) != 0) {
+      return false;
+    }
+    erased_sectors_ |= mask;
+  }
+
+  return true;
+}
+
+bool Bootloader::ReadHashTlv(const struct flash_area *fa, size_t image_length,
+                             uint8_t *hash, size_t *end) {
+  // The TLVs directly follow the image body.
+  size_t offset = image_length;
+  struct image_tlv_info info;
+  if (offset + sizeof(info) > fa->fa_size ||
+      flash_area_read(fa, offset, &info, sizeof(info)) != 0 ||
+      info.it_magic != IMAGE_TLV_INFO_MAGIC ||
+      info.it_tlv_tot > fa->fa_size - offset) {
+    return false;
+  }
+  *end = offset + info.it_tlv_tot;
+  offset += sizeof(info);
+
+  struct image_tlv tlv;
+  while (offset + sizeof(tlv) <= *end &&
+         flash_area_read(fa, offset, &tlv, sizeof(tlv)) == 0) {
+    offset += sizeof(tlv);
+    if (tlv.it_type == IMAGE_TLV_SHA256 &&
+        tlv.it_len == TC_SHA256_DIGEST_SIZE && offset + tlv.it_len <= *end) {
+      return flash_area_read(fa, offset, hash, tlv.it_len) == 0;
+    }
+    offset += tlv.it_len;
+  }
+
+  return false;
+}
+
+void Bootloader::UpdateHash(const struct flash_area *fa) {
+  while (!image_invalid_ && IsWritten(hashed_length_, 1)) {
+    // The header at the start of the image defines the hashed length.
+    if (image_length_ == 0) {
+      struct image_header hdr;
+      if (flash_area_read(fa, 0, &hdr, sizeof(hdr)) != 0 ||
+          hdr.ih_magic != IMAGE_MAGIC ||
+          hdr.ih_hdr_size + hdr.ih_img_size > MaxImageSize()) {
+        image_invalid_ = true;
+        return;
+      }
+      image_length_ = hdr.ih_hdr_size + hdr.ih_img_size;
+    }
+
+    if (hashed_length_ >= image_length_) {
+      return;
+    }
+
+    size_t end = std::min((hashed_length_ / kChunkSize + 1) * kChunkSize,
+                          image_length_);
+    while (hashed_length_ < end) {
+      uint8_t buf[kHashReadSize];
+      size_t n = std::min(end - hashed_length_, kHashReadSize);
+      flash_area_read(fa, hashed_length_, buf, n);
+      tc_sha256_update(&sha_, buf, n);
+      hashed_length_ += n;
+    }
+
+    if (hashed_length_ == image_length_) {
+      tc_sha256_final(digest_, &sha_);
+    }
+  }
+}
+
+bool Bootloader::IsWritten(size_t offset, size_t length) const {
+  if (length == 0) {
+    return true;
+  }
+
+  size_t last = (offset + length - 1) / kChunkSize;
+  if (last >= 32) {
+    return false;
+  }
+
+  for (size_t chunk = offset / kChunkSize; chunk <= last; chunk++) {
+    if (!(written_chunks_ & (1u << chunk))) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -3,14 +3,65 @@
 #ifndef BSP_BOOTLOADER_H_
 #define BSP_BOOTLOADER_H_
 
+#include <cstdint>
+
+#include "tinycrypt/sha256.h"
+
 #include "bootloader_interface.h"
 
+struct flash_area;
+
+// The update slot is erased one sector at a time just before the first write
+// to it. Erasing the whole slot at once takes longer than MODBUS masters wait
+// for a response.
+//
+// Written data is read back and hashed in order so that a broken upload is
+// detected before the reset into the bootloader.
 class Bootloader final : public BootloaderInterface {
  public:
   bool PrepareUpdate() override;
   bool WriteImageData(size_t offset, uint8_t* data, size_t length) override;
+  size_t MaxImageSize() override;
+  bool ReadImageData(size_t offset, uint8_t* data, size_t length) override;
+  size_t HashedLength() override { return hashed_length_; }
+  bool ImageDigest(uint8_t* digest) override;
+  bool VerifyUpdate() override;
+  bool UpdateSlotCrc32(size_t offset, size_t length, uint32_t* crc) override;
+  bool ReadRunningImage(size_t offset, uint8_t* data, size_t length) override;
+  bool RunningImageDigest(uint8_t* digest) override;
   bool SetUpdatePending() override;
   bool SetUpdateConfirmed() override;
+
+ private:
+  // Granularity of the written data tracking for the hash.
+  static constexpr size_t kChunkSize = 512;
+
+  // Reads the SHA-256 TLV of the image which ends at image_length. end is set
+  // to the end of the TLV area.
+  static bool ReadHashTlv(const struct flash_area* fa, size_t image_length,
+                          uint8_t* hash, size_t* end);
+
+  // Hashes the written chunks following the already hashed data.
+  void UpdateHash(const struct flash_area* fa);
+
+  // All chunks in the range were written since the last PrepareUpdate().
+  bool IsWritten(size_t offset, size_t length) const;
+
+  // Erases all sectors in the range that were not erased since the last
+  // PrepareUpdate() call.
+  bool EraseSectors(const struct flash_area* fa, size_t offset, size_t length);
+
+  // One bit per sector of the update slot.
+  uint32_t erased_sectors_ = 0;
+
+  // One bit per chunk of the update slot.
+  uint32_t written_chunks_ = 0;
+
+  struct tc_sha256_state_struct sha_;
+  size_t hashed_length_ = 0;
+  size_t image_length_ = 0;  // Header and body, 0 while unknown.
+  bool image_invalid_ = false;
+  uint8_t digest_[TC_SHA256_DIGEST_SIZE];
 };
 
 #endif  // BSP_BOOTLOADER_H_
@@ -3,9 +3,12 @@
 #include "bsp/bsp.h"
 
 #include <algorithm>
+#include <cstring>
 
 #include "chip.h"
 
+#include "modbus/modbus.h"
+
 // Required by the vendor chip library.
 extern "C" {
 
@@ -16,59 +19,276 @@ const uint32_t ExtRateIn = 0;  // External clock input not used.
 
 Bootloader bootloader;
 ModbusSerial modbus_serial(LPC_USART0, LPC_MRT_CH0);
+SystemClock system_clock(LPC_MRT_CH3);
+Platform platform(modbus_serial, LPC_MRT_CH2);
+Residency residency(platform);
 
 constexpr int kMeasurementStartDelayMs = 5;
 
+// ADC channel connected to the capacitive (moisture) signal.
+constexpr uint8_t kAdcMoistureChannel = 9;
+
+// Channels of one measurement. The sequencer converts them in ascending order:
+// low (3), high (9) and diodes (10).
+constexpr uint32_t kAdcChannels = ADC_SEQ_CTRL_CHANSEL(3) |
+                                  ADC_SEQ_CTRL_CHANSEL(9) |
+                                  ADC_SEQ_CTRL_CHANSEL(10);
+
+// ADC hardware trigger input 2 is the SCT output 3 on the LPC82x (see user
+// manual UM10800). The vendor header names are copied from a different family.
+constexpr uint32_t kAdcTriggerSctOut3 = (2 << 12);
+
+// DMA channel 0 is meant for USART0 RX requests which are not used because the
+// UART is serviced by interrupts. Hardware triggers work on any channel.
+constexpr DMA_CHID_T kCaptureDmaChannel = DMA_CH0;
+
+// Three conversions take 75 ADC clocks: 2.5us at 30MHz.
+constexpr uint16_t kMinCaptureIntervalUs = 3;
+
+// 16 exceptions and 32 interrupts. VTOR requires the table to be aligned to
+// its size rounded up to the next power of two.
+constexpr size_t kNumVectors = 48;
+constexpr size_t kVectorTableAlignment = 256;
+
+// Bytes received while the flash is busy: A complete RTU frame. A sector erase
+// (about 100ms) alone lasts 190 bytes at 19200 baud.
+constexpr size_t kFlashBusyRxSize = 256;
+
+// Parity error flag in the USART RXDATA_STAT register.
+constexpr uint32_t kRxDatStatParityError = (1 << 14);
+
+// Shortest RTU frame: Address, function code and CRC.
+constexpr size_t kMinFrameSize = 4;
+
+// Exception response: Address, function code, exception code and CRC.
+constexpr size_t kBusyResponseSize = 5;
+
+// Number of MRT channels. All of them share one interrupt.
+constexpr size_t kNumMrtChannels = 4;
+
 namespace {
 
-void SetPower(uint32_t mode) {
-  uint32_t clk_mhz = SystemCoreClock / 1'000'000;
-  uint32_t param[] = {clk_mhz, mode, clk_mhz};
-  uint32_t result;
-  LPC_ROM_API->pPWRD->set_power(param, &result);
-  assert(result == PWR_CMD_SUCCESS);
+// Set by interrupt handlers, consumed by the main loop.
+ThresholdAlarms threshold_alarms;
+
+// Raw ADC sequence A global data register values written by the DMA.
+uint32_t capture_buffer[kCaptureSamples];
+size_t capture_length = 0;
+
+// Vector table while the flash is busy. Only the UART and the MRT interrupts
+// are enabled and handled by ISRs in RAM.
+__attribute__((aligned(kVectorTableAlignment)))
+void (*flash_busy_vectors[kNumVectors])();
+uint32_t flash_vtor = 0;
+uint32_t flash_busy_saved_irqs = 0;
+uint32_t flash_busy_saved_mrt_ctrl[kNumMrtChannels];
+
+// The frame in reception when the flash got busy. Its remaining bytes are
+// buffered and passed on to ModbusSerial when the flash is ready again.
+enum class HeldFrame : uint8_t {
+  kNone,
+  kReceiving,
+  kComplete,
+};
+
+// Answers requests to this address with the busy exception.
+uint8_t flash_busy_address = 0;
+uint32_t flash_busy_gap_ticks = 0;
+
+volatile HeldFrame flash_busy_held = HeldFrame::kNone;
+volatile size_t flash_busy_held_length = 0;
+volatile bool flash_busy_held_error = false;
+
+// Received bytes: The rest of the held frame followed by the frame in
+// reception.
+volatile uint8_t flash_busy_rx[kFlashBusyRxSize];
+volatile size_t flash_busy_rx_count = 0;
+
+// The frame in reception, checked while it is received because only its
+// last bytes fit into the buffer.
+volatile size_t flash_busy_frame_length = 0;
+volatile uint8_t flash_busy_frame_head[2];  // Address and function code
+volatile uint16_t flash_busy_frame_crc = 0xFFFF;
+volatile bool flash_busy_frame_error = false;
+
+volatile uint8_t flash_busy_tx[kBusyResponseSize];
+volatile size_t flash_busy_tx_count = 0;
+volatile size_t flash_busy_tx_length = 0;
+
+volatile uint16_t flash_busy_dropped_frames = 0;
+
+// The ISRs below run from RAM while the flash is busy and must not call any
+// code in flash. Only direct register accesses, no divisions.
+
+__attribute__((section(".ramfunc"))) uint16_t FlashBusyCrc16(uint16_t crc,
+                                                            uint8_t data) {
+  crc ^= data;
+  for (int i = 0; i < 8; i++) {
+    crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  }
+  return crc;
 }
 
-void UseIrc() {
-  Chip_Clock_SetMainClockSource(SYSCTL_MAINCLKSRC_IRC);
-  Chip_Clock_SetSysClockDiv(1);
-  Chip_FMC_SetFLASHAccess(FLASHTIM_20MHZ_CPU);
-  Chip_SYSCTL_PowerDown(SYSCTL_SLPWAKE_SYSPLL_PD);
+// Buffers the received bytes for ModbusSerial which is not accessible while
+// the flash is busy. The inter-frame timeout runs on MRT channel 0 as usual.
+// Sends the busy response.
+__attribute__((section(".ramfunc"))) void FlashBusyUartIsr() {
+  uint32_t stat = LPC_USART0->STAT;
+
+  if (stat & UART_STAT_START) {
+    LPC_MRT_CH0->INTVAL = 0 | MRT_INTVAL_LOAD;
+  }
+
+  if (stat & UART_STAT_RXRDY) {
+    uint32_t rx = LPC_USART0->RXDATA_STAT;
+    uint8_t data = static_cast<uint8_t>(rx);
+    LPC_MRT_CH0->INTVAL = flash_busy_gap_ticks | MRT_INTVAL_LOAD;
+
+    size_t n = flash_busy_frame_length;
+    if (n < sizeof(flash_busy_frame_head)) {
+      flash_busy_frame_head[n] = data;
+    }
+    flash_busy_frame_crc = FlashBusyCrc16(flash_busy_frame_crc, data);
+    flash_busy_frame_length = n + 1;
+
+    size_t i = flash_busy_rx_count;
+    if (i < kFlashBusyRxSize && !(rx & kRxDatStatParityError)) {
+      flash_busy_rx[i] = data;
+      flash_busy_rx_count = i + 1;
+    } else {
+      flash_busy_frame_error = true;
+    }
+  }
+
+  if ((stat & UART_STAT_TXRDY) && flash_busy_tx_count < flash_busy_tx_length) {
+    size_t i = flash_busy_tx_count;
+    LPC_USART0->TXDATA = flash_busy_tx[i];
+    flash_busy_tx_count = i + 1;
+    if (i + 1 == flash_busy_tx_length) {
+      LPC_USART0->INTENCLR = UART_INTEN_TXRDY;
+    }
+  }
+
+  LPC_USART0->STAT = UART_STAT_START | UART_STAT_PAR_ERRINT;
+}
 
-  // Update CMSIS clock frequency variable which is used in iap.c
-  SystemCoreClock = 12'000'000;
+// Handles the end of a frame, detected by the inter-frame timeout. The other
+// MRT channels do not raise interrupts while the flash is busy.
+__attribute__((section(".ramfunc"))) void FlashBusyMrtIsr() {
+  if (!(LPC_MRT_CH0->STAT & MRT_STAT_INTFLAG)) {
+    return;
+  }
+  LPC_MRT_CH0->STAT = MRT_STAT_INTFLAG;
+
+  if (flash_busy_held == HeldFrame::kReceiving) {
+    flash_busy_held = HeldFrame::kComplete;
+    flash_busy_held_length = flash_busy_rx_count;
+    flash_busy_held_error = flash_busy_frame_error;
+  } else if (flash_busy_frame_length >= kMinFrameSize &&
+             !flash_busy_frame_error && flash_busy_frame_crc == 0) {
+    // A valid frame. The CRC over a frame including its CRC is zero.
+    uint8_t address = flash_busy_frame_head[0];
+    if (address == 0) {
+      // Broadcasts have no response, the master does not notice the loss.
+      flash_busy_dropped_frames++;
+    } else if (address == flash_busy_address &&
+               flash_busy_tx_count == flash_busy_tx_length) {
+      uint16_t crc = 0xFFFF;
+      flash_busy_tx[0] = address;
+      flash_busy_tx[1] = flash_busy_frame_head[1] | 0x80;
+      flash_busy_tx[2] =
+          static_cast<uint8_t>(modbus::ExceptionCode::kSlaveDeviceBusy);
+      for (size_t i = 0; i < 3; i++) {
+        crc = FlashBusyCrc16(crc, flash_busy_tx[i]);
+      }
+      flash_busy_tx[3] = crc & 0xFF;
+      flash_busy_tx[4] = crc >> 8;
+      flash_busy_tx_count = 0;
+      flash_busy_tx_length = kBusyResponseSize;
+      LPC_USART0->INTENSET = UART_INTEN_TXRDY;
+    }
+  }
+
+  // The next frame follows the held frame in the buffer.
+  flash_busy_rx_count = flash_busy_held_length;
+  flash_busy_frame_length = 0;
+  flash_busy_frame_crc = 0xFFFF;
+  flash_busy_frame_error = false;
+}
 
-  SetPower(PWR_LOW_CURRENT);
+// Polls the MRT channel 1 which does not raise interrupts. The main clock must
+// not change while the timeout runs.
+void StartTimeoutMs(uint32_t ms) {
+  Chip_MRT_IntClear(LPC_MRT_CH1);
+  Chip_MRT_SetInterval(LPC_MRT_CH1,
+                       (ms * (SystemCoreClock / 1'000)) | MRT_INTVAL_LOAD);
 }
 
-void UsePll() {
-  SetPower(PWR_DEFAULT);
+bool TimeoutExpired() { return Chip_MRT_IntPending(LPC_MRT_CH1); }
 
-  Chip_SYSCTL_PowerUp(SYSCTL_SLPWAKE_SYSPLL_PD);
-  while (!Chip_Clock_IsSystemPLLLocked())
-    ;
+void StopTimeout() { Chip_MRT_SetInterval(LPC_MRT_CH1, 0 | MRT_INTVAL_LOAD); }
+
+// Latches the threshold comparison of the last moisture conversion.
+void LatchThresholdAlarm() {
+  uint32_t flag = ADC_FLAGS_THCMP_MASK(kAdcMoistureChannel);
+  if (!(Chip_ADC_GetFlags(LPC_ADC) & flag)) {
+    return;
+  }
+
+  uint32_t data = Chip_ADC_GetDataReg(LPC_ADC, kAdcMoistureChannel);
+  switch (ADC_DR_THCMPRANGE(data)) {
+    case ADC_DR_THCMPRANGE_BELOW:
+      threshold_alarms.Latch(ThresholdAlarms::Range::kBelow);
+      break;
+
+    case ADC_DR_THCMPRANGE_ABOVE:
+      threshold_alarms.Latch(ThresholdAlarms::Range::kAbove);
+      break;
 
-  // Main clock frequency: 60MHz / 2 = 30Mhz
-  Chip_FMC_SetFLASHAccess(FLASHTIM_30MHZ_CPU);
-  Chip_Clock_SetSysClockDiv(2);
-  Chip_Clock_SetMainClockSource(SYSCTL_MAINCLKSRC_PLLOUT);
+    default:
+      break;
+  }
 
-  // Update CMSIS clock frequency variable which is used in iap.c
-  SystemCoreClock = 30000000;
+  Chip_ADC_ClearFlags(LPC_ADC, flag);
 }
 
-// Configures system clock to 30MHz with the PLL fed by the internal oscillator.
-void SetupClock() {
-  UseIrc();
+// Disables the threshold interrupt before the alarms are disarmed. The last
+// armed conversion is latched first: Its interrupt is not handled yet when
+// the measurement runs with interrupts disabled.
+void StopThresholdInt() {
+  if (threshold_alarms.armed()) {
+    Chip_ADC_SetThresholdInt(LPC_ADC, kAdcMoistureChannel,
+                             ADC_INTEN_THCMP_DISABLE);
+    LatchThresholdAlarm();
+  }
+}
+
+// Enables the threshold interrupt again when the alarms are armed. Comparisons
+// of the conversions in between are discarded.
+void StartThresholdInt() {
+  if (threshold_alarms.armed()) {
+    Chip_ADC_ClearFlags(LPC_ADC, ADC_FLAGS_THCMP_MASK(kAdcMoistureChannel));
+    NVIC_ClearPendingIRQ(ADC_THCMP_IRQn);
+    Chip_ADC_SetThresholdInt(LPC_ADC, kAdcMoistureChannel,
+                             ADC_INTEN_THCMP_OUTSIDE);
+  }
+}
 
-  // Cannot use vendor provided routine in ROM memory to setup the system clock.
-  // It does not support setting 30MHz as output frequency.
+// Residency requires interrupts disabled. Measurements run from tasks with
+// interrupts enabled but also from a MODBUS request with interrupts disabled.
+Residency::State EnterResidency(Residency::State state) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  Residency::State previous = residency.Enter(state);
+  __set_PRIMASK(primask);
+  return previous;
+}
 
-  // PLL input FCLKIN (10-25MHz): IRC = 12MHz
-  // PLL output FCLKOUT (<100MHz): 5 * 12MHz = 60MHz
-  // PLL intrenal FCCO (156-320MHz): 2 * 2 * 60MHz = 240Mhz
-  Chip_Clock_SetSystemPLLSource(SYSCTL_PLLCLKSRC_IRC);
-  Chip_Clock_SetupSystemPLL(4, 1);
+void WaitMs(uint32_t ms) {
+  StartTimeoutMs(ms);
+  while (!TimeoutExpired())
+    ;
+  StopTimeout();
 }
 
 // Enables LED output and sets ADC pins to analog mode.
@@ -132,6 +352,15 @@ void SetupSwichMatrix() {
   Chip_SWM_Deinit();
 }
 
+// Sets up the measurement sequence. Triggered by software unless a hardware
+// trigger input is selected.
+void SetupSequencer(uint32_t options) {
+  Chip_ADC_DisableSequencer(LPC_ADC, ADC_SEQA_IDX);
+  Chip_ADC_SetupSequencer(LPC_ADC, ADC_SEQA_IDX,
+                          kAdcChannels | ADC_SEQ_CTRL_HWTRIG_POLPOS | options);
+  Chip_ADC_EnableSequencer(LPC_ADC, ADC_SEQA_IDX);
+}
+
 // Calibrates the ADC and sets up a measurement sequence.
 void SetupAdc() {
   Chip_ADC_Init(LPC_ADC, 0);
@@ -151,13 +380,18 @@ void SetupAdc() {
   Chip_ADC_SetDivider(LPC_ADC, 0);
   LPC_ADC->CTRL |= ADC_CR_LPWRMODEBIT;
 
-  Chip_ADC_SetupSequencer(LPC_ADC, ADC_SEQA_IDX,
-                          ADC_SEQ_CTRL_CHANSEL(3) | ADC_SEQ_CTRL_CHANSEL(9) |
-                              ADC_SEQ_CTRL_CHANSEL(10) | ADC_SEQ_CTRL_MODE_EOS |
-                              ADC_SEQ_CTRL_HWTRIG_POLPOS);
-  Chip_ADC_EnableSequencer(LPC_ADC, ADC_SEQA_IDX);
+  SetupSequencer(ADC_SEQ_CTRL_MODE_EOS);
 
   Chip_ADC_EnableInt(LPC_ADC, ADC_INTEN_SEQA_ENABLE);
+
+  // Let the hardware compare each conversion of the moisture channel with the
+  // threshold register set 0. The thresholds are fully open until configured.
+  Chip_ADC_SetThrLowValue(LPC_ADC, 0, 0);
+  Chip_ADC_SetThrHighValue(LPC_ADC, 0, 0xFFF);
+  Chip_ADC_SelectTH0Channels(LPC_ADC,
+                             ADC_THRSEL_CHAN_SEL_THR1(kAdcMoistureChannel));
+  Chip_ADC_SetThresholdInt(LPC_ADC, kAdcMoistureChannel,
+                           ADC_INTEN_THCMP_OUTSIDE);
 }
 
 // Sets up a PWM output with 50% duty cycle used as excitation signal for the
@@ -168,8 +402,9 @@ void SetupPwm() {
   // Set output frequency with the reload match 0 value. This value is loaded
   // to the match register with each limit event.
   // The timer must expire two times during one PWM cycle (PWM_FREQ * 2) to
-  // create complementary outputs with two timer states.
-  // Use the fastet possible pwm frequency by setting the reload value to 0:
+  // create complementary outputs with two timer states:
+  // PWM_FREQ = 30MHz / (2 * (reload + 1))
+  // Use the fastet possible pwm frequency by default with a reload value of 0:
   // 30MHz / 2 = 15MHz
   LPC_SCT->MATCHREL[0].L = 0;
 
@@ -199,10 +434,87 @@ void SetupPwm() {
 
   // Restart counter on event 0 and 1 (match occurred)
   LPC_SCT->LIMIT_L = (1 << 0) | (1 << 1);
+
+  // The otherwise unused H counter paces the ADC in capture mode. It counts
+  // microseconds and creates a rising edge on the internal output 3 (ADC
+  // hardware trigger) once per sample interval set by match register 1.
+  LPC_SCT->EV[2].STATE = (1 << 0);
+  LPC_SCT->EV[3].STATE = (1 << 0);
+  LPC_SCT->EV[2].CTRL =
+      (1 << 0) |  // Use match register 1 for comparison
+      (1 << 4) |  // HEVENT[4] = Event belongs to the H counter
+      (1 << 12);  // COMBMODE[13:12] = Match only
+  LPC_SCT->EV[3].CTRL =
+      (2 << 0) |  // Use match register 2 for comparison
+      (1 << 4) |  // HEVENT[4] = Event belongs to the H counter
+      (1 << 12);  // COMBMODE[13:12] = Match only
+  LPC_SCT->MATCH[2].H = 0;
+  LPC_SCT->OUT[3].SET = (1 << 2);  // Event 2 sets (triggers the ADC)
+  LPC_SCT->OUT[3].CLR = (1 << 3);  // Event 3 clears on counter restart
+  LPC_SCT->LIMIT_H = (1 << 2);
+
+  // Capture runs with the PLL clock: 30MHz / (29 + 1) = 1MHz
+  Chip_SCT_SetControl(LPC_SCT, SCT_CTRL_PRE_H(29));
+}
+
+// Moves each ADC sequence A conversion result to the capture buffer.
+// One DMA descriptor covers the whole buffer.
+void SetupCaptureDma() {
+  Chip_DMA_Init(LPC_DMA);
+  Chip_DMA_Enable(LPC_DMA);
+  Chip_DMA_SetSRAMBase(LPC_DMA, DMA_ADDR(Chip_DMA_Table));
+
+  Chip_DMATRIGMUX_SetInputTrig(LPC_DMATRIGMUX, kCaptureDmaChannel,
+                               DMATRIG_ADC_SEQA_IRQ);
+  Chip_DMA_SetupChannelConfig(
+      LPC_DMA, kCaptureDmaChannel,
+      DMA_CFG_HWTRIGEN | DMA_CFG_TRIGPOL_HIGH | DMA_CFG_TRIGTYPE_EDGE |
+          DMA_CFG_TRIGBURST_BURST | DMA_CFG_BURSTPOWER_1 |
+          DMA_CFG_CHPRIORITY(0));
+
+  DMA_CHDESC_T &desc = Chip_DMA_Table[kCaptureDmaChannel];
+  desc.source = DMA_ADDR(&LPC_ADC->SEQ_GDAT[ADC_SEQA_IDX]);
+  desc.dest = DMA_ADDR(&capture_buffer[kCaptureSamples - 1]);
+  desc.next = 0;
+
+  Chip_DMA_ClearActiveIntAChannel(LPC_DMA, kCaptureDmaChannel);
+  Chip_DMA_SetupChannelTransfer(
+      LPC_DMA, kCaptureDmaChannel,
+      DMA_XFERCFG_CFGVALID | DMA_XFERCFG_SETINTA | DMA_XFERCFG_WIDTH_32 |
+          DMA_XFERCFG_SRCINC_0 | DMA_XFERCFG_DSTINC_1 |
+          DMA_XFERCFG_XFERCOUNT(kCaptureSamples));
+  Chip_DMA_SetValidChannel(LPC_DMA, kCaptureDmaChannel);
+  Chip_DMA_EnableChannel(LPC_DMA, kCaptureDmaChannel);
+}
+
+void StopCaptureDma() {
+  Chip_DMA_DisableChannel(LPC_DMA, kCaptureDmaChannel);
+  while (Chip_DMA_GetBusyChannels(LPC_DMA) & (1 << kCaptureDmaChannel))
+    ;
+  Chip_DMA_AbortChannel(LPC_DMA, kCaptureDmaChannel);
+  Chip_DMA_Disable(LPC_DMA);
+  Chip_DMA_DeInit(LPC_DMA);
 }
 
 // Use the multirate timer for various timing related like delays.
-void SetupTimers() { Chip_MRT_Init(); }
+// Channel 0: MODBUS inter-frame timeout
+// Channel 1: Busy wait delays and timeouts
+// Channel 2: Awake time before entering deep sleep
+// Channel 3: PLL keep-warm time
+void SetupTimers() {
+  Chip_MRT_Init();
+
+  Chip_MRT_SetMode(LPC_MRT_CH1, MRT_MODE_ONESHOT);
+}
+
+// Copies the vector table to RAM and redirects the UART and MRT interrupts.
+void SetupFlashBusyVectors() {
+  flash_vtor = SCB->VTOR;
+  memcpy(flash_busy_vectors, reinterpret_cast<void *>(flash_vtor),
+         sizeof(flash_busy_vectors));
+  flash_busy_vectors[16 + UART0_IRQn] = FlashBusyUartIsr;
+  flash_busy_vectors[16 + MRT_IRQn] = FlashBusyMrtIsr;
+}
 
 // Configures and enables interrupts.
 void SetupNVIC() {
@@ -211,15 +523,28 @@ void SetupNVIC() {
 
   NVIC_SetPriority(MRT_IRQn, 1);
   NVIC_EnableIRQ(MRT_IRQn);
+
+  NVIC_SetPriority(ADC_THCMP_IRQn, 2);
+  NVIC_EnableIRQ(ADC_THCMP_IRQn);
+
+  NVIC_SetPriority(WKT_IRQn, 1);
+  NVIC_EnableIRQ(WKT_IRQn);
+
+  // Only needed to wake up from deep sleep.
+  NVIC_EnableIRQ(PININT0_IRQn);
 }
 
 }  // namespace
 
 void BspSetup() {
-  SetupClock();
+  SetupTimers();
+  system_clock.Init();
+  platform.Init();
+  residency.Reset();
+  modbus_serial.set_residency(&residency);
   SetupAdc();
   SetupPwm();
-  SetupTimers();
+  SetupFlashBusyVectors();
   SetupNVIC();
 }
 
@@ -228,50 +553,221 @@ void BspSetupPins() {
   SetupSwichMatrix();
 }
 
-void BspSleep() { __WFI(); }
-
 void BspReset() { NVIC_SystemReset(); }
 
-RawMeasurement BspMeasureRaw() {
+RawMeasurement BspMeasureRaw(uint16_t pwm_reload) {
+  RawMeasurement rm;
+  BspMeasureSweep(&pwm_reload, &rm, 1);
+  return rm;
+}
+
+void BspMeasureSweep(const uint16_t *pwm_reloads, RawMeasurement *results,
+                     size_t num_points) {
+  Residency::State previous = EnterResidency(Residency::kMeasure);
+
   // Switch to faster clock.
-  UsePll();
+  system_clock.RequestFast();
 
-  // Start the PWM timer.
+  // Start the PWM timer. The counter is halted so the match register can be
+  // written directly for the first period.
+  LPC_SCT->COUNT_L = 0;
+  LPC_SCT->MATCH[0].L = pwm_reloads[0];
+  LPC_SCT->MATCHREL[0].L = pwm_reloads[0];
   LPC_SCT->CTRL_L &= (uint16_t)~SCT_CTRL_HALT_L;
 
-  // Wait until capacitor is charged.
-  Chip_Clock_EnablePeriphClock(SYSCTL_CLOCK_WKT);
-  Chip_WKT_ClearIntStatus(LPC_WKT);
-  Chip_WKT_Start(LPC_WKT, WKT_CLKSRC_DIVIRC,
-                 kMeasurementStartDelayMs * 750'000 / 1'000);
-  while (!Chip_WKT_GetIntStatus(LPC_WKT))
-    ;
-  Chip_Clock_DisablePeriphClock(SYSCTL_CLOCK_WKT);
+  for (size_t i = 0; i < num_points; i++) {
+    // Takes effect with the next limit event of the running counter.
+    LPC_SCT->MATCHREL[0].L = pwm_reloads[i];
 
-  // Start and wait for ADC conversion to finish.
-  Chip_ADC_ClearFlags(LPC_ADC, ADC_FLAGS_SEQA_INT_MASK);
-  Chip_ADC_StartSequencer(LPC_ADC, ADC_SEQA_IDX);
+    // Only the normal excitation may latch an alarm.
+    StopThresholdInt();
+    threshold_alarms.SelectPwmReload(pwm_reloads[i]);
+    StartThresholdInt();
 
-  // Wait for conversion to be finished.
-  while ((Chip_ADC_GetFlags(LPC_ADC) & ADC_FLAGS_SEQA_INT_MASK) == 0)
-    ;
+    // Wait until capacitor is charged.
+    WaitMs(kMeasurementStartDelayMs);
+
+    // Start and wait for ADC conversion to finish.
+    Chip_ADC_ClearFlags(LPC_ADC, ADC_FLAGS_SEQA_INT_MASK);
+    Chip_ADC_StartSequencer(LPC_ADC, ADC_SEQA_IDX);
+
+    // Wait for conversion to be finished.
+    while ((Chip_ADC_GetFlags(LPC_ADC) & ADC_FLAGS_SEQA_INT_MASK) == 0)
+      ;
+
+    results[i].low = ADC_DR_RESULT(Chip_ADC_GetDataReg(LPC_ADC, 3));
+    results[i].high = ADC_DR_RESULT(Chip_ADC_GetDataReg(LPC_ADC, 9));
+    results[i].diodes = ADC_DR_RESULT(Chip_ADC_GetDataReg(LPC_ADC, 10));
+  }
 
   // Stop the PWM timer.
   LPC_SCT->CTRL_L |= (uint16_t)SCT_CTRL_HALT_L;
 
+  // The background sampling uses the normal excitation.
+  StopThresholdInt();
+  threshold_alarms.Resume();
+  StartThresholdInt();
+
   // Go back no normal clock rate to save power.
-  UseIrc();
+  system_clock.ReleaseFast();
 
-  RawMeasurement rm;
-  rm.low = ADC_DR_RESULT(Chip_ADC_GetDataReg(LPC_ADC, 3));
-  rm.high = ADC_DR_RESULT(Chip_ADC_GetDataReg(LPC_ADC, 9));
-  rm.diodes = ADC_DR_RESULT(Chip_ADC_GetDataReg(LPC_ADC, 10));
-  return rm;
+  EnterResidency(previous);
 }
 
+bool BspCaptureRaw(uint16_t interval_us) {
+  interval_us = std::min(std::max(interval_us, kMinCaptureIntervalUs),
+                         kMaxCaptureIntervalUs);
+  capture_length = 0;
+
+  Residency::State previous = EnterResidency(Residency::kMeasure);
+
+  // The settling is expected to cross the thresholds.
+  StopThresholdInt();
+  threshold_alarms.Suspend();
+
+  // The capture takes place at the fast clock rate, like a real measurement.
+  system_clock.RequestFast();
+
+  SetupSequencer(kAdcTriggerSctOut3);  // One DMA request per conversion
+  SetupCaptureDma();
+
+  LPC_SCT->OUTPUT &= ~(1u << 3);
+  LPC_SCT->COUNT_H = 0;
+  LPC_SCT->MATCH[1].H = interval_us - 1;
+
+  // Start the PWM and the sample clock simultaneously.
+  LPC_SCT->COUNT_L = 0;
+  LPC_SCT->MATCH[0].L = 0;
+  LPC_SCT->MATCHREL[0].L = 0;
+  LPC_SCT->CTRL_U &= ~(SCT_CTRL_HALT_L | SCT_CTRL_HALT_H);
+
+  // Allow twice the expected duration before giving up.
+  uint32_t duration_ms = kCaptureSamples / 3 * interval_us / 1'000 + 1;
+  StartTimeoutMs(2 * duration_ms);
+  bool done = false;
+  while (!done && !TimeoutExpired()) {
+    done = Chip_DMA_GetActiveIntAChannels(LPC_DMA) & (1 << kCaptureDmaChannel);
+  }
+  StopTimeout();
+
+  LPC_SCT->CTRL_U |= SCT_CTRL_HALT_L | SCT_CTRL_HALT_H;
+  StopCaptureDma();
+  SetupSequencer(ADC_SEQ_CTRL_MODE_EOS);
+
+  threshold_alarms.Resume();
+  StartThresholdInt();
+
+  system_clock.ReleaseFast();
+
+  EnterResidency(previous);
+
+  if (done) {
+    capture_length = kCaptureSamples;
+  }
+  return done;
+}
+
+size_t BspCaptureLength() { return capture_length; }
+
+uint16_t BspCaptureSample(size_t index) {
+  if (index >= capture_length) {
+    return 0;
+  }
+  return ADC_DR_RESULT(capture_buffer[index]);
+}
+
+void BspSetAlarmThresholds(uint16_t low, uint16_t high) {
+  Chip_ADC_SetThrLowValue(LPC_ADC, 0, low);
+  Chip_ADC_SetThrHighValue(LPC_ADC, 0, high);
+}
+
+uint16_t BspAlarms() { return threshold_alarms.flags(); }
+
+void BspClearAlarms() { threshold_alarms.Clear(); }
+
+uint16_t BspFlashBusyDroppedFrames() { return flash_busy_dropped_frames; }
+
 BspInterruptFree::BspInterruptFree() { __disable_irq(); }
 BspInterruptFree::~BspInterruptFree() { __enable_irq(); }
 
+BspFlashBusy::BspFlashBusy(uint8_t address) {
+  BspInterruptFree _;
+
+  // Pass on a frame that just ended.
+  modbus_serial.TimerIsr();
+
+  flash_busy_address = address;
+  flash_busy_gap_ticks = modbus_serial.InterFrameTicks();
+  flash_busy_held =
+      modbus_serial.idle() ? HeldFrame::kNone : HeldFrame::kReceiving;
+  flash_busy_held_length = 0;
+  flash_busy_held_error = false;
+  flash_busy_rx_count = 0;
+  flash_busy_frame_length = 0;
+  flash_busy_frame_crc = 0xFFFF;
+  flash_busy_frame_error = false;
+  flash_busy_tx_count = 0;
+  flash_busy_tx_length = 0;
+
+  // Only the inter-frame timeout on channel 0 may raise the shared interrupt.
+  // Expired timeouts of the other channels are handled afterwards.
+  for (size_t ch = 1; ch < kNumMrtChannels; ch++) {
+    flash_busy_saved_mrt_ctrl[ch] = LPC_MRT->CHANNEL[ch].CTRL;
+    LPC_MRT->CHANNEL[ch].CTRL &= ~MRT_CTRL_INTEN_MASK;
+  }
+
+  flash_busy_saved_irqs = NVIC->ISER[0];
+  NVIC->ICER[0] = ~((1u << UART0_IRQn) | (1u << MRT_IRQn));
+  SCB->VTOR = reinterpret_cast<uint32_t>(flash_busy_vectors);
+}
+
+BspFlashBusy::~BspFlashBusy() {
+  BspInterruptFree _;
+
+  // ModbusSerial takes over the UART after the busy response.
+  FlashBusyMrtIsr();
+  while (flash_busy_tx_count < flash_busy_tx_length ||
+         !(LPC_USART0->STAT & UART_STAT_TXIDLE)) {
+    FlashBusyUartIsr();
+    FlashBusyMrtIsr();
+  }
+
+  SCB->VTOR = flash_vtor;
+  for (size_t ch = 1; ch < kNumMrtChannels; ch++) {
+    LPC_MRT->CHANNEL[ch].CTRL = flash_busy_saved_mrt_ctrl[ch];
+  }
+
+  // Pass on the held frame, or the frame in reception when there is none.
+  // A frame in reception after a complete held frame would merge with it and
+  // is dropped.
+  size_t length = flash_busy_rx_count;
+  bool error = flash_busy_frame_error;
+  bool complete = flash_busy_held == HeldFrame::kComplete;
+  if (complete) {
+    length = flash_busy_held_length;
+    error = flash_busy_held_error;
+    uint8_t address = flash_busy_frame_head[0];
+    if (flash_busy_frame_length > 0 &&
+        (address == 0 || address == flash_busy_address)) {
+      flash_busy_dropped_frames++;
+    }
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    modbus_serial.Receive(flash_busy_rx[i], true);
+  }
+  if (error) {
+    // The protocol ignores all bytes after a parity error until the bus is
+    // idle.
+    modbus_serial.Receive(0, false);
+  }
+  if (complete) {
+    modbus_serial.EndFrame();
+  }
+
+  NVIC->ISER[0] = flash_busy_saved_irqs;
+}
+
 // Implementaion for newlib assert()
 extern "C" void __assert_func(const char *, int, const char *, const char *) {
   BspInterruptFree _;
@@ -281,5 +777,18 @@ extern "C" void __assert_func(const char *, int, const char *, const char *) {
 }
 
 // Interrupt Service Routines
-void MRT_Handler() { modbus_serial.TimerIsr(); }
+void MRT_Handler() {
+  modbus_serial.TimerIsr();
+  system_clock.TimerIsr();
+  platform.AwakeTimerIsr();
+}
+
+void WKT_Handler() { platform.WakeupTimerIsr(); }
+
 void UART0_Handler() { modbus_serial.UartIsr(); }
+
+void PIN_INT0_Handler() { platform.PinIsr(); }
+
+// Only fires for samples outside of the configured thresholds. The result of
+// the comparison is stored alongside the conversion result.
+void ADC_THCMP_Handler() { LatchThresholdAlarm(); }
@@ -3,10 +3,16 @@
 #ifndef BSP_BSP_H_
 #define BSP_BSP_H_
 
+#include <cstddef>
 #include <cstdint>
 
 #include "bsp/bootloader.h"
 #include "bsp/modbus_serial.h"
+#include "bsp/platform.h"
+#include "bsp/system_clock.h"
+#include "residency.h"
+#include "settings.h"
+#include "threshold_alarms.h"
 
 struct RawMeasurement {
   uint16_t low;
@@ -14,17 +20,65 @@ struct RawMeasurement {
   uint16_t diodes;
 };
 
+// Number of raw ADC values recorded by a capture: 170 measurement sequences.
+constexpr size_t kCaptureSamples = 510;
+
+// Longest capture interval. Keeps the whole capture below 100ms:
+// 170 sequences * 500us = 85ms.
+constexpr uint16_t kMaxCaptureIntervalUs = 500;
+
 extern Bootloader bootloader;
 extern ModbusSerial modbus_serial;
+extern SystemClock system_clock;
+extern Platform platform;
+extern Residency residency;
 
 void BspSetup();
 void BspSetupPins();
 
-void BspSleep();
-
 void BspReset();
 
-RawMeasurement BspMeasureRaw();
+// The measurements may run with interrupts enabled. Only the UART, MRT, WKT
+// and ADC threshold interrupts are serviced meanwhile, none of them touches
+// the SCT or the ADC sequencer. The threshold interrupt stays disabled for
+// sweep points with other than the normal excitation and for the whole
+// capture.
+
+// Measures with a PWM excitation frequency of 30MHz / (2 * (pwm_reload + 1)).
+// The default reload value of 0 selects the highest frequency: 15MHz.
+RawMeasurement BspMeasureRaw(uint16_t pwm_reload = 0);
+
+// Measures at multiple excitation frequencies in a row. Saves switching the
+// clock and restarting the PWM for each point.
+void BspMeasureSweep(const uint16_t *pwm_reloads, RawMeasurement *results,
+                     size_t num_points);
+
+// Records the ADC continuously from the start of the 15MHz PWM excitation
+// through settling. One sequence (low, high, diodes) is converted every
+// interval_us microseconds and moved to a RAM buffer with DMA.
+// Returns false when the capture did not complete.
+bool BspCaptureRaw(uint16_t interval_us);
+
+// Number of values recorded by the last capture. Values are ordered low, high,
+// diodes for each sequence.
+size_t BspCaptureLength();
+uint16_t BspCaptureSample(size_t index);
+
+// Configures the ADC hardware threshold comparison of the moisture channel.
+// Samples of the normal measurement outside of [low, high] latch an alarm flag
+// (AlarmFlags).
+void BspSetAlarmThresholds(uint16_t low, uint16_t high);
+uint16_t BspAlarms();
+void BspClearAlarms();
+
+// Reads the settings from flash.
+// Returns false when no valid settings were stored.
+bool BspLoadSettings(Settings *settings);
+
+// Permanently stores the settings in flash.
+// Interrupts must be disabled because the flash is not accessible while it is
+// being programmed.
+bool BspStoreSettings(const Settings &settings);
 
 class BspInterruptFree {
  public:
@@ -32,4 +86,24 @@ class BspInterruptFree {
   ~BspInterruptFree();
 };
 
+// Keeps the MODBUS bus served while the flash is programmed with interrupts
+// enabled. All interrupts but the UART and the MRT inter-frame timeout are
+// masked and both are serviced from RAM:
+// - The frame in reception at the start is buffered and passed on at the end
+//   of the scope.
+// - Complete requests to address are answered with the busy exception (6)
+//   so that the master retries them.
+// - A frame still in reception at the end is passed on when it did not follow
+//   the frame held from the start.
+// A transmission must not be in progress.
+class BspFlashBusy {
+ public:
+  explicit BspFlashBusy(uint8_t address);
+  ~BspFlashBusy();
+};
+
+// Frames lost while the flash was busy: Broadcasts, which cannot be answered
+// with the busy exception, and frames dropped at the end of the busy time.
+uint16_t BspFlashBusyDroppedFrames();
+
 #endif  // BSP_BSP_H_
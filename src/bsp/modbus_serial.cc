@@ -2,12 +2,19 @@
 
 #include "bsp/modbus_serial.h"
 
+#include <algorithm>
+
+#include "residency.h"
+#include "scheduler.h"
+
 void ModbusSerial::Init(uint32_t baudrate) {
   assert(usart_ != nullptr);
   assert(mrt_ch_ != nullptr);
 
+  baudrate_ = baudrate;
+
   // Enable global UART clock. Divide clock down as much as possible.
-  Chip_Clock_SetUARTClockDiv(Chip_Clock_GetMainClockRate() / (16 * baudrate));
+  SetBaseClock();
 
   // Configure peripheral.
   Chip_UART_Init(usart_);
@@ -35,9 +42,7 @@ void ModbusSerial::Enable() {
 
   // Wait for a inter-frame timeout which then puts the stack in operational
   // (idle) state.
-  Chip_MRT_SetInterval(
-      mrt_ch_,
-      ((Chip_Clock_GetSystemClockRate() / 1000000) * 1750) | MRT_INTVAL_LOAD);
+  StartInterFrameTimer();
 }
 
 void ModbusSerial::Disable() {
@@ -52,18 +57,80 @@ void ModbusSerial::Disable() {
 
 void ModbusSerial::Send(const uint8_t* data, size_t length) {
   tx_active_ = true;
+  if (residency_ != nullptr) {
+    residency_->StartTransmit();
+  }
   tx_data_ = data;
   tx_data_end_ = data + length;
   Chip_UART_IntEnable(usart_, UART_INTEN_TXRDY);
 }
 
+bool ModbusSerial::idle() const {
+  // The inter-frame timer runs from the first received byte until the frame
+  // has been passed to the protocol.
+  return !tx_active_ && !Chip_MRT_Running(mrt_ch_) &&
+         (Chip_UART_GetStatus(usart_) & UART_STAT_RXIDLE);
+}
+
+void ModbusSerial::ClockChanged(uint32_t old_hz, uint32_t new_hz) {
+  // The baudrate generator divider stays the same when the UART base clock
+  // is kept constant.
+  SetBaseClock();
+
+  // Scale the remaining time of a running inter-frame timeout.
+  if (Chip_MRT_Running(mrt_ch_)) {
+    uint32_t remaining = Chip_MRT_GetTimer(mrt_ch_);
+    uint32_t scaled = remaining / (old_hz / 1'000'000) * (new_hz / 1'000'000);
+    scaled = std::max<uint32_t>(scaled, 1);
+    Chip_MRT_SetInterval(mrt_ch_, scaled | MRT_INTVAL_LOAD);
+  }
+}
+
+void ModbusSerial::SetBaseClock() {
+  // Integer divider for the coarse rate and the fractional baudrate
+  // generator for the rest: rate = main / (div * (1 + mult / 256))
+  // Written directly instead of using Chip_Clock_SetUSARTNBaseClockRate()
+  // which resets the fractional generator and glitches the running UART.
+  uint32_t rate = 16 * baudrate_;
+  uint32_t main_hz = Chip_Clock_GetMainClockRate();
+  uint32_t div = std::max<uint32_t>(main_hz / rate, 1);
+  uint32_t mult = (main_hz / div * 256) / rate - 256;
+
+  Chip_Clock_SetUARTClockDiv(div);
+  Chip_SYSCTL_SetUSARTFRGDivider(0xFF);
+  Chip_SYSCTL_SetUSARTFRGMultiplier(mult);
+}
+
+uint32_t ModbusSerial::InterFrameTicks() const {
+  return (Chip_Clock_GetSystemClockRate() / 1000000) * 1750;
+}
+
+void ModbusSerial::StartInterFrameTimer() {
+  Chip_MRT_SetInterval(mrt_ch_, InterFrameTicks() | MRT_INTVAL_LOAD);
+}
+
 void ModbusSerial::TimerIsr() {
   if (Chip_MRT_IntPending(mrt_ch_)) {
-    Chip_MRT_IntClear(mrt_ch_);
-    rtu_->BusIdle();
+    EndFrame();
+  }
+}
+
+void ModbusSerial::EndFrame() {
+  Chip_MRT_SetInterval(mrt_ch_, 0 | MRT_INTVAL_LOAD);
+  Chip_MRT_IntClear(mrt_ch_);
+  rtu_->BusIdle();
+  if (scheduler_ != nullptr) {
+    scheduler_->Post(frame_task_);
   }
 }
 
+void ModbusSerial::Receive(uint8_t data, bool parity_ok) {
+  // Start inter frame-delay timer.
+  StartInterFrameTimer();
+
+  rtu_->RxByte(data, parity_ok);
+}
+
 void ModbusSerial::UartIsr() {
   uint32_t uart_ints = Chip_UART_GetIntStatus(usart_);
 
@@ -73,13 +140,8 @@ void ModbusSerial::UartIsr() {
   }
 
   if (uart_ints & UART_STAT_RXRDY) {
-    // Start inter frame-delay timer.
-    Chip_MRT_SetInterval(
-        mrt_ch_,
-        ((Chip_Clock_GetSystemClockRate() / 1000000) * 1750) | MRT_INTVAL_LOAD);
-
     uint8_t rxdata = Chip_UART_ReadByte(usart_);
-    rtu_->RxByte(rxdata, !(uart_ints & UART_STAT_PAR_ERRINT));
+    Receive(rxdata, !(uart_ints & UART_STAT_PAR_ERRINT));
 
     Chip_UART_ClearStatus(usart_, UART_STAT_PAR_ERRINT);
   }
@@ -96,6 +158,9 @@ void ModbusSerial::UartIsr() {
 
   if (uart_ints & UART_STAT_TXIDLE) {
     tx_active_ = false;
+    if (residency_ != nullptr) {
+      residency_->StopTransmit();
+    }
     rtu_->TxDone();
     Chip_UART_IntDisable(usart_, UART_STAT_TXIDLE);
   }
@@ -3,12 +3,19 @@
 #ifndef BSP_MODBUS_SERIAL_H_
 #define BSP_MODBUS_SERIAL_H_
 
+#include <cstddef>
+
 #include "chip.h"
 
+#include "bsp/system_clock.h"
 #include "modbus/rtu_protocol.h"
 #include "modbus/serial_interface.h"
 
-class ModbusSerial final : public modbus::SerialInterface {
+class Residency;
+class Scheduler;
+
+class ModbusSerial final : public modbus::SerialInterface,
+                           public ClockListener {
  public:
   ModbusSerial(LPC_USART_T *usart, LPC_MRT_CH_T *mrt_ch)
       : usart_(usart), mrt_ch_(mrt_ch) {}
@@ -23,15 +30,54 @@ class ModbusSerial final : public modbus::SerialInterface {
   void TimerIsr();
   void UartIsr();
 
+  // Ends the frame in reception like an inter-frame timeout. Used when the
+  // timeout expired while the MRT interrupt was not serviced.
+  void EndFrame();
+
+  // Passes a received byte to the protocol and restarts the inter-frame
+  // timeout. Also used for bytes buffered while the UART interrupt was not
+  // serviced.
+  void Receive(uint8_t data, bool parity_ok);
+
+  // Keeps the baudrate and the inter-frame timeout when the main clock
+  // changes.
+  void ClockChanged(uint32_t old_hz, uint32_t new_hz) override;
+
   void set_modbus_rtu(modbus::RtuProtocol *modbus_rtu) { rtu_ = modbus_rtu; }
+
+  // Posts the task when a frame is complete.
+  void set_frame_task(Scheduler *scheduler, size_t task) {
+    scheduler_ = scheduler;
+    frame_task_ = task;
+  }
+
+  // Accounts the time spent transmitting.
+  void set_residency(Residency *residency) { residency_ = residency; }
+
   bool tx_active() const { return tx_active_; }
 
+  // No transmission in progress and no frame being received.
+  bool idle() const;
+
+  // Inter-frame timeout in MRT ticks at the current main clock.
+  uint32_t InterFrameTicks() const;
+
  private:
+  void SetBaseClock();
+  void StartInterFrameTimer();
+
   LPC_USART_T *const usart_;
   LPC_MRT_CH_T *const mrt_ch_;
 
+  uint32_t baudrate_ = 0;
+
   modbus::RtuProtocol *rtu_ = nullptr;
 
+  Scheduler *scheduler_ = nullptr;
+  size_t frame_task_ = 0;
+
+  Residency *residency_ = nullptr;
+
   volatile bool tx_active_ = false;
   const uint8_t *tx_data_ = nullptr;
   const uint8_t *tx_data_end_ = nullptr;
@@ -0,0 +1,200 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "bsp/platform.h"
+
+#include <algorithm>
+
+namespace {
+
+// UART0 RXD pin. A falling edge (start bit) wakes the MCU from deep sleep.
+constexpr uint8_t kRxPin = 14;
+
+// Time to stay awake after a wakeup or after bus activity. The frame that
+// caused the wakeup is lost (its start bit is missed) but the retry of the
+// MODBUS master arrives within this window.
+constexpr uint32_t kAwakeTimeMs = 1000;
+
+// Longest time between two timer reloads. Limits the range of the arithmetic
+// in Platform::UpdateTime().
+constexpr uint32_t kMaxTimerMs = 1000;
+
+// Oscillator ticks measured against the IRC during calibration.
+constexpr uint32_t kCalibrationTicks = 100;
+
+// IRC startup and rounding to full oscillator ticks. Estimated from the data
+// sheet, not measured. Deep sleep stays off by default until it is.
+constexpr uint32_t kDeepSleepLatencyMs = 1;
+
+// SysTick runs as free running down counter of IRC cycles.
+uint32_t IrcCyclesSince(uint32_t start) {
+  return (start - SysTick->VAL) & SysTick_LOAD_RELOAD_Msk;
+}
+
+void WaitWakeupTimer(uint32_t ticks) {
+  Chip_WKT_ClearIntStatus(LPC_WKT);
+  Chip_WKT_LoadCount(LPC_WKT, ticks);
+  while (!Chip_WKT_GetIntStatus(LPC_WKT))
+    ;
+}
+
+}  // namespace
+
+void Platform::Init() {
+  Chip_Clock_EnablePeriphClock(SYSCTL_CLOCK_WKT);
+  LPC_PMU->DPDCTRL |= PMU_DPDCTRL_LPOSCEN;
+  Chip_WKT_SetClockSource(LPC_WKT, WKT_CLKSRC_10KHZ);
+
+  // Start measuring at a tick edge.
+  WaitWakeupTimer(1);
+  uint32_t start = SysTick->VAL;
+  WaitWakeupTimer(kCalibrationTicks);
+  lposc_hz_ = kCalibrationTicks * 12'000'000 / IrcCyclesSince(start);
+
+  StartTimer(kMaxTimerMs * lposc_hz_ / 1'000);
+
+  // The wakeup timer ends deep sleep at deadlines. The RX pin is routed to pin
+  // interrupt 0 to wake up with a MODBUS frame. The edge interrupt itself is
+  // only enabled while in deep sleep.
+  LPC_SYSCTL->STARTERP1 |= SYSCTL_WAKEUP_WKTINT;
+  Chip_SYSCTL_SetPinInterrupt(0, kRxPin);
+  Chip_SYSCTL_EnablePINTWakeup(0);
+
+  // Keep the IRC running but power down everything else in deep sleep.
+  Chip_SYSCTL_SetDeepSleepPD(SYSCTL_DEEPSLP_BOD_PD | SYSCTL_DEEPSLP_WDTOSC_PD);
+
+  Chip_MRT_SetMode(awake_mrt_ch_, MRT_MODE_ONESHOT);
+  Chip_MRT_SetEnabled(awake_mrt_ch_);  // Enable interrupt
+}
+
+uint32_t Platform::Now() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  UpdateTime();
+  uint32_t now = now_ms_;
+  __set_PRIMASK(primask);
+  return now;
+}
+
+SleepMode Platform::DeepestSleepMode() {
+  if (!deep_sleep_enabled_) {
+    return SleepMode::kSleep;
+  }
+
+  // Stay awake while the bus is active.
+  if (!serial_.idle()) {
+    RestartAwakeTime();
+    return SleepMode::kSleep;
+  }
+
+  // Running MRT timeouts would stall in deep sleep.
+  for (uint8_t i = 0; i < MRT_CHANNELS_NUM; i++) {
+    if (Chip_MRT_Running(Chip_MRT_GetRegPtr(i))) {
+      return SleepMode::kSleep;
+    }
+  }
+
+  return SleepMode::kDeepSleep;
+}
+
+uint32_t Platform::WakeupLatencyMs(SleepMode mode) {
+  return (mode == SleepMode::kDeepSleep) ? kDeepSleepLatencyMs : 0;
+}
+
+void Platform::Sleep(SleepMode mode, uint32_t timeout_ms) {
+  // Rounded down to not wake up late. Waking up early is fine.
+  timeout_ms = std::min(timeout_ms, kMaxTimerMs);
+  StartTimer(std::max<uint32_t>(timeout_ms * lposc_hz_ / 1'000, 1));
+
+  if (mode == SleepMode::kDeepSleep) {
+    DeepSleep();
+  } else {
+    __WFI();
+  }
+}
+
+void Platform::SetDeepSleep(bool enabled) {
+  // The pin interrupt registers are clocked together with the GPIOs.
+  if (enabled) {
+    Chip_Clock_EnablePeriphClock(SYSCTL_CLOCK_GPIO);
+    RestartAwakeTime();
+  } else {
+    Chip_Clock_DisablePeriphClock(SYSCTL_CLOCK_GPIO);
+  }
+  deep_sleep_enabled_ = enabled;
+}
+
+void Platform::WakeupTimerIsr() {
+  // Keep the timebase running.
+  StartTimer(kMaxTimerMs * lposc_hz_ / 1'000);
+}
+
+void Platform::AwakeTimerIsr() {
+  // End of the awake time only needs to wake up the scheduler.
+  if (Chip_MRT_IntPending(awake_mrt_ch_)) {
+    Chip_MRT_IntClear(awake_mrt_ch_);
+  }
+}
+
+void Platform::PinIsr() {
+  // Woken up from deep sleep. Everything else is handled in DeepSleep().
+  Chip_PININT_DisableIntLow(LPC_PININT, PININTCH0);
+  Chip_PININT_ClearIntStatus(LPC_PININT, PININTCH0);
+}
+
+void Platform::UpdateTime() {
+  // The timer counts down and stops at 0 until reloaded.
+  uint32_t count = LPC_WKT->COUNT;
+  uint32_t scaled = now_remainder_ + (last_count_ - count) * 1'000;
+  last_count_ = count;
+
+  now_ms_ += scaled / lposc_hz_;
+  now_remainder_ = scaled % lposc_hz_;
+}
+
+void Platform::StartTimer(uint32_t ticks) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  UpdateTime();
+
+  // The counter must be cleared before loading a new value.
+  Chip_WKT_Stop(LPC_WKT);
+  Chip_WKT_ClearIntStatus(LPC_WKT);
+  NVIC_ClearPendingIRQ(WKT_IRQn);
+  Chip_WKT_LoadCount(LPC_WKT, ticks);
+  last_count_ = ticks;
+
+  __set_PRIMASK(primask);
+}
+
+void Platform::RestartAwakeTime() {
+  Chip_MRT_SetInterval(
+      awake_mrt_ch_,
+      (kAwakeTimeMs * (SystemCoreClock / 1'000)) | MRT_INTVAL_LOAD);
+}
+
+// Waits for a start bit on the RX line or the wakeup timer with all clocks
+// but the low power oscillator stopped.
+void Platform::DeepSleep() {
+  // Restore the current power configuration after wakeup.
+  Chip_SYSCTL_SetWakeup(Chip_SYSCTL_GetPowerStates());
+
+  Chip_PININT_SetPinModeEdge(LPC_PININT, PININTCH0);
+  Chip_PININT_ClearIntStatus(LPC_PININT, PININTCH0);
+  Chip_PININT_EnableIntLow(LPC_PININT, PININTCH0);  // Falling edge
+
+  Chip_PMU_DeepSleepState(LPC_PMU);
+
+  // Only wake from deep sleep when explicitly requested.
+  SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+
+  bool rx_wakeup = Chip_PININT_GetIntStatus(LPC_PININT) & PININTCH0;
+  Chip_PININT_DisableIntLow(LPC_PININT, PININTCH0);
+  Chip_PININT_ClearIntStatus(LPC_PININT, PININTCH0);
+  NVIC_ClearPendingIRQ(PININT0_IRQn);
+
+  if (rx_wakeup) {
+    wakeups_++;
+    RestartAwakeTime();
+  }
+}
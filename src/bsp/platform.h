@@ -0,0 +1,68 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef BSP_PLATFORM_H_
+#define BSP_PLATFORM_H_
+
+#include <cstdint>
+
+#include "chip.h"
+
+#include "bsp/modbus_serial.h"
+#include "platform_interface.h"
+
+// Timebase and sleep modes for the scheduler.
+//
+// The wakeup timer (WKT) clocked by the low power oscillator keeps the time
+// and wakes up at deadlines. Unlike the MRT it is independent of the main
+// clock and keeps running in deep sleep. The oscillator is only accurate to
+// +-40% and therefore calibrated against the IRC at startup.
+class Platform final : public PlatformInterface {
+ public:
+  Platform(ModbusSerial &serial, LPC_MRT_CH_T *awake_mrt_ch)
+      : serial_(serial), awake_mrt_ch_(awake_mrt_ch) {}
+
+  // Requires SysTick to be running from the IRC.
+  void Init();
+
+  uint32_t Now() override;
+  SleepMode DeepestSleepMode() override;
+  uint32_t WakeupLatencyMs(SleepMode mode) override;
+  void Sleep(SleepMode mode, uint32_t timeout_ms) override;
+  void DisableInterrupts() override { __disable_irq(); }
+  void EnableInterrupts() override { __enable_irq(); }
+
+  // Deep sleep wakes up with the start bit of a MODBUS frame. The UART misses
+  // this first frame so the MODBUS master must retry.
+  void SetDeepSleep(bool enabled);
+
+  // Number of wakeups from deep sleep by the RX line.
+  uint16_t wakeups() const { return wakeups_; }
+
+  void WakeupTimerIsr();
+  void AwakeTimerIsr();
+  void PinIsr();
+
+ private:
+  // Adds the ticks elapsed since the last call to the time.
+  void UpdateTime();
+
+  // Loads a new count to the running wakeup timer.
+  void StartTimer(uint32_t ticks);
+
+  void RestartAwakeTime();
+  void DeepSleep();
+
+  ModbusSerial &serial_;
+  LPC_MRT_CH_T *const awake_mrt_ch_;
+
+  uint32_t lposc_hz_ = 10'000;
+
+  uint32_t now_ms_ = 0;
+  uint32_t now_remainder_ = 0;  // Fraction of a millisecond * lposc_hz_.
+  uint32_t last_count_ = 0;
+
+  bool deep_sleep_enabled_ = false;
+  uint16_t wakeups_ = 0;
+};
+
+#endif  // BSP_PLATFORM_H_
@@ -0,0 +1,86 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "bsp/bsp.h"
+
+#include <cstring>
+
+#include "etl/crc16_modbus.h"
+
+#include "flash_map_backend/flash_map_backend.h"
+#include "sysflash/sysflash.h"
+
+namespace {
+
+constexpr uint32_t kSettingsMagic = 0x53534553;  // "SESS" little endian
+
+struct StoredSettings {
+  uint32_t magic;
+  uint16_t size;
+  uint16_t crc;
+  Settings settings;
+};
+
+// Flash writes must be a multiple of the 4 byte write size.
+constexpr size_t kStoredSize = (sizeof(StoredSettings) + 3) & ~3u;
+
+// Covers the first size bytes which were written by the storing firmware.
+uint16_t SettingsCrc(const Settings &settings, size_t size) {
+  auto data = reinterpret_cast<const uint8_t *>(&settings);
+  return etl::crc16_modbus(data, data + size).value();
+}
+
+}  // namespace
+
+bool BspLoadSettings(Settings *settings) {
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_SETTINGS, &fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  StoredSettings stored;
+  rc = flash_area_read(fa, 0, &stored, sizeof(stored));
+  flash_area_close(fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  // Reject erased flash and settings stored by a newer firmware. An older
+  // firmware stored a prefix of the current settings: The fields appended
+  // since then start with their defaults.
+  if (stored.magic != kSettingsMagic || stored.size == 0 ||
+      stored.size > sizeof(Settings) ||
+      stored.crc != SettingsCrc(stored.settings, stored.size)) {
+    return false;
+  }
+
+  *settings = kDefaultSettings;
+  memcpy(settings, &stored.settings, stored.size);
+  return true;
+}
+
+bool BspStoreSettings(const Settings &settings) {
+  union {
+    StoredSettings stored;
+    uint32_t words[kStoredSize / 4];  // Word alignment for flash writes.
+  } buf;
+  memset(&buf, 0xFF, sizeof(buf));
+  buf.stored.magic = kSettingsMagic;
+  buf.stored.size = sizeof(Settings);
+  buf.stored.crc = SettingsCrc(settings, sizeof(settings));
+  buf.stored.settings = settings;
+
+  const struct flash_area *fa;
+  int rc = flash_area_open(FLASH_AREA_SETTINGS, &fa);
+  if (rc != 0) {
+    return false;
+  }
+
+  rc = flash_area_erase(fa, 0, fa->fa_size);
+  if (rc == 0) {
+    rc = flash_area_write(fa, 0, buf.words, kStoredSize);
+  }
+
+  flash_area_close(fa);
+  return rc == 0;
+}
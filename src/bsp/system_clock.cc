@@ -0,0 +1,175 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "bsp/system_clock.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+// Time the PLL keeps running after the last release.
+constexpr uint32_t kPllKeepWarmMs = 100;
+
+void SetPower(uint32_t mode) {
+  uint32_t clk_mhz = SystemCoreClock / 1'000'000;
+  uint32_t param[] = {clk_mhz, mode, clk_mhz};
+  uint32_t result;
+  LPC_ROM_API->pPWRD->set_power(param, &result);
+  assert(result == PWR_CMD_SUCCESS);
+}
+
+// SysTick is used as free running down counter of CPU cycles. The cycles
+// are only comparable while the main clock does not change.
+uint32_t Cycles() { return SysTick->VAL; }
+
+uint32_t CyclesBetween(uint32_t start, uint32_t end) {
+  return (start - end) & SysTick_LOAD_RELOAD_Msk;
+}
+
+uint32_t CyclesToUs(uint32_t cycles, uint32_t hz) {
+  return cycles / (hz / 1'000'000);
+}
+
+uint16_t SaturateUs(uint32_t us) { return std::min<uint32_t>(us, UINT16_MAX); }
+
+// Time since start at the current main clock.
+uint16_t ElapsedUs(uint32_t start) {
+  return SaturateUs(
+      CyclesToUs(CyclesBetween(start, Cycles()), SystemCoreClock));
+}
+
+}  // namespace
+
+void SystemClock::Init() {
+  SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+  SysTick->VAL = 0;
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+
+  UseIrc();
+  Chip_SYSCTL_PowerDown(SYSCTL_SLPWAKE_SYSPLL_PD);
+
+  // Cannot use vendor provided routine in ROM memory to setup the system clock.
+  // It does not support setting 30MHz as output frequency.
+
+  // PLL input FCLKIN (10-25MHz): IRC = 12MHz
+  // PLL output FCLKOUT (<100MHz): 5 * 12MHz = 60MHz
+  // PLL intrenal FCCO (156-320MHz): 2 * 2 * 60MHz = 240Mhz
+  Chip_Clock_SetSystemPLLSource(SYSCTL_PLLCLKSRC_IRC);
+  Chip_Clock_SetupSystemPLL(4, 1);
+
+  Chip_MRT_SetMode(mrt_ch_, MRT_MODE_ONESHOT);
+  Chip_MRT_SetEnabled(mrt_ch_);  // Enable interrupt
+}
+
+void SystemClock::AddListener(ClockListener *listener) {
+  assert(num_listeners_ < kMaxListeners);
+  listeners_[num_listeners_++] = listener;
+}
+
+void SystemClock::RequestFast() {
+  if (fast_requests_++ > 0) {
+    return;
+  }
+
+  // Cancel the pending power down.
+  Chip_MRT_SetInterval(mrt_ch_, 0 | MRT_INTVAL_LOAD);
+
+  uint32_t start = Cycles();
+  UsePll();
+  stats_.last_request_us = ElapsedAcrossSwitchUs(start);
+}
+
+void SystemClock::ReleaseFast() {
+  assert(fast_requests_ > 0);
+  if (--fast_requests_ > 0) {
+    return;
+  }
+
+  uint32_t start = Cycles();
+  UseIrc();
+  stats_.last_release_us = ElapsedAcrossSwitchUs(start);
+
+  Chip_MRT_SetInterval(
+      mrt_ch_, (kPllKeepWarmMs * (SystemCoreClock / 1'000)) | MRT_INTVAL_LOAD);
+}
+
+void SystemClock::TimerIsr() {
+  if (Chip_MRT_IntPending(mrt_ch_)) {
+    Chip_MRT_IntClear(mrt_ch_);
+    if (fast_requests_ == 0) {
+      Chip_SYSCTL_PowerDown(SYSCTL_SLPWAKE_SYSPLL_PD);
+    }
+  }
+}
+
+void SystemClock::UseIrc() {
+  // Switch and listener updates must not be interrupted.
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  uint32_t old_hz = SystemCoreClock;
+  Chip_Clock_SetMainClockSource(SYSCTL_MAINCLKSRC_IRC);
+  Chip_Clock_SetSysClockDiv(1);
+  Chip_FMC_SetFLASHAccess(FLASHTIM_20MHZ_CPU);
+  switch_cycles_ = Cycles();
+  switch_old_hz_ = old_hz;
+
+  // Update CMSIS clock frequency variable which is used in iap.c
+  SystemCoreClock = 12'000'000;
+  NotifyListeners(old_hz);
+
+  __set_PRIMASK(primask);
+
+  SetPower(PWR_LOW_CURRENT);
+}
+
+void SystemClock::UsePll() {
+  SetPower(PWR_DEFAULT);
+
+  // Wait for the lock with interrupts enabled.
+  if (Chip_Clock_IsSystemPLLLocked()) {
+    stats_.pll_reuses++;
+  } else {
+    uint32_t start = Cycles();
+    Chip_SYSCTL_PowerUp(SYSCTL_SLPWAKE_SYSPLL_PD);
+    while (!Chip_Clock_IsSystemPLLLocked())
+      ;
+    stats_.last_lock_us = ElapsedUs(start);
+    stats_.max_lock_us = std::max(stats_.max_lock_us, stats_.last_lock_us);
+    stats_.pll_starts++;
+  }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  // Main clock frequency: 60MHz / 2 = 30Mhz
+  uint32_t old_hz = SystemCoreClock;
+  Chip_FMC_SetFLASHAccess(FLASHTIM_30MHZ_CPU);
+  Chip_Clock_SetSysClockDiv(2);
+  Chip_Clock_SetMainClockSource(SYSCTL_MAINCLKSRC_PLLOUT);
+  switch_cycles_ = Cycles();
+  switch_old_hz_ = old_hz;
+
+  // Update CMSIS clock frequency variable which is used in iap.c
+  SystemCoreClock = 30000000;
+  NotifyListeners(old_hz);
+
+  __set_PRIMASK(primask);
+}
+
+uint16_t SystemClock::ElapsedAcrossSwitchUs(uint32_t start) const {
+  uint32_t before = CyclesBetween(start, switch_cycles_);
+  uint32_t after = CyclesBetween(switch_cycles_, Cycles());
+  return SaturateUs(CyclesToUs(before, switch_old_hz_) +
+                    CyclesToUs(after, SystemCoreClock));
+}
+
+void SystemClock::NotifyListeners(uint32_t old_hz) {
+  if (old_hz == SystemCoreClock) {
+    return;
+  }
+
+  for (size_t i = 0; i < num_listeners_; i++) {
+    listeners_[i]->ClockChanged(old_hz, SystemCoreClock);
+  }
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef BSP_SYSTEM_CLOCK_H_
+#define BSP_SYSTEM_CLOCK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "chip.h"
+
+// Peripherals clocked from the main clock implement this interface to keep
+// their timing across clock switches.
+class ClockListener {
+ public:
+  // Called with interrupts disabled right after the main clock changed.
+  virtual void ClockChanged(uint32_t old_hz, uint32_t new_hz) = 0;
+
+ protected:
+  ~ClockListener() = default;
+};
+
+// Switches the main clock between the 12MHz IRC and the 30MHz PLL output.
+// The PLL output is reference counted: The main clock runs from the PLL while
+// at least one user requested it. The PLL stays powered (and locked) for a
+// short time after the last release so that back-to-back measurements do not
+// wait for the PLL to lock again.
+class SystemClock {
+ public:
+  // Durations in microseconds measured with the SysTick counter.
+  struct Stats {
+    uint16_t pll_starts;       // Requests that powered up the PLL.
+    uint16_t pll_reuses;       // Requests served by the still locked PLL.
+    uint16_t last_lock_us;     // Last wait for the PLL lock.
+    uint16_t max_lock_us;      // Longest wait for the PLL lock.
+    uint16_t last_request_us;  // Last switch to the PLL, including the lock.
+    uint16_t last_release_us;  // Last switch back to the IRC.
+  };
+
+  explicit SystemClock(LPC_MRT_CH_T *mrt_ch) : mrt_ch_(mrt_ch) {}
+
+  // Configures the PLL and selects the IRC as main clock.
+  void Init();
+
+  void AddListener(ClockListener *listener);
+
+  void RequestFast();
+  void ReleaseFast();
+
+  // Powers down the PLL when the keep-warm time elapsed.
+  void TimerIsr();
+
+  const Stats &stats() const { return stats_; }
+
+ private:
+  static constexpr size_t kMaxListeners = 2;
+
+  void UseIrc();
+  void UsePll();
+  void NotifyListeners(uint32_t old_hz);
+
+  // Time since start which includes the last clock switch. SysTick counts CPU
+  // cycles, so the cycles before and after the switch use different rates.
+  uint16_t ElapsedAcrossSwitchUs(uint32_t start) const;
+
+  LPC_MRT_CH_T *const mrt_ch_;
+
+  ClockListener *listeners_[kMaxListeners] = {};
+  size_t num_listeners_ = 0;
+
+  unsigned fast_requests_ = 0;
+
+  // SysTick value and main clock right before the last switch.
+  uint32_t switch_cycles_ = 0;
+  uint32_t switch_old_hz_ = 0;
+
+  Stats stats_ = {};
+};
+
+#endif  // BSP_SYSTEM_CLOCK_H_
@@ -0,0 +1,47 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "calibration.h"
+
+constexpr size_t Calibration::kMaxPoints;
+constexpr uint16_t Calibration::kMaxVwc;
+constexpr uint16_t Calibration::kInvalid;
+
+bool Calibration::IsValid() const {
+  if (num_points < 2 || num_points > kMaxPoints) {
+    return false;
+  }
+
+  for (size_t i = 0; i < num_points; i++) {
+    if (points[i].vwc > kMaxVwc) {
+      return false;
+    }
+    if (i > 0 && points[i].raw <= points[i - 1].raw) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint16_t Calibration::Apply(uint16_t raw) const {
+  if (!IsValid()) {
+    return kInvalid;
+  }
+
+  if (raw <= points[0].raw) {
+    return points[0].vwc;
+  }
+
+  for (size_t i = 1; i < num_points; i++) {
+    const CalibrationPoint &p0 = points[i - 1];
+    const CalibrationPoint &p1 = points[i];
+    if (raw <= p1.raw) {
+      // Limiting VWC to kMaxVwc keeps the product within 30bit.
+      int32_t dx = p1.raw - p0.raw;
+      int32_t dy = p1.vwc - p0.vwc;
+      return p0.vwc + (raw - p0.raw) * dy / dx;
+    }
+  }
+
+  return points[num_points - 1].vwc;
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+struct CalibrationPoint {
+  uint16_t raw;
+  uint16_t vwc;
+};
+
+// Piecewise linear curve to convert raw measurement counts to volumetric
+// water content (VWC) in units of 0.01%.
+// Only uses integer arithmetic because the Cortex-M0 has no FPU and soft-float
+// is too large for the flash memory.
+// Plain data so that it can be stored in flash as part of the settings.
+struct Calibration {
+  static constexpr size_t kMaxPoints = 8;
+
+  // 100.00%
+  static constexpr uint16_t kMaxVwc = 10000;
+
+  // Returned by Apply() when no valid calibration curve is available.
+  static constexpr uint16_t kInvalid = 0xFFFF;
+
+  // A curve requires at least two points with strictly ascending raw values
+  // and VWC values of at most kMaxVwc.
+  bool IsValid() const;
+
+  // Returns the interpolated VWC for a raw value. Values outside of the curve
+  // are clamped to the first or last point.
+  uint16_t Apply(uint16_t raw) const;
+
+  uint16_t num_points;
+  CalibrationPoint points[kMaxPoints];
+};
+
+#endif  // CALIBRATION_H_
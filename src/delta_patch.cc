@@ -0,0 +1,123 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "delta_patch.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr uint32_t DeltaPatch::kMagic;
+constexpr size_t DeltaPatch::kHeaderSize;
+constexpr size_t DeltaPatch::kCopyChunkSize;
+
+void DeltaPatch::Reset() {
+  state_ = State::kHeader;
+  field_length_ = 0;
+}
+
+bool DeltaPatch::Next(LzDecoder& input, uint8_t* byte) {
+  for (;;) {
+    switch (state_) {
+      case State::kHeader:
+        if (!ReadField(input, kHeaderSize)) {
+          return false;
+        }
+        CheckHeader();
+        break;
+
+      case State::kOp: {
+        if (!ReadField(input, 1)) {
+          return false;
+        }
+        size_t length = field_[0] == kCopy ? 5 : 3;
+        if (!ReadField(input, length)) {
+          return false;
+        }
+        StartOp();
+      } break;
+
+      case State::kCopy:
+        if (remaining_ == 0) {
+          state_ = State::kOp;
+          break;
+        }
+        if (copy_chunk_pos_ == copy_chunk_length_) {
+          copy_chunk_length_ = std::min(remaining_, kCopyChunkSize);
+          copy_chunk_pos_ = 0;
+          if (!bootloader_.ReadRunningImage(copy_offset_, copy_chunk_,
+                                            copy_chunk_length_)) {
+            state_ = State::kFailed;
+            return false;
+          }
+          copy_offset_ += copy_chunk_length_;
+        }
+        *byte = copy_chunk_[copy_chunk_pos_++];
+        remaining_--;
+        return true;
+
+      case State::kInsert:
+        if (remaining_ == 0) {
+          state_ = State::kOp;
+          break;
+        }
+        if (!input.Next(byte)) {
+          return false;
+        }
+        remaining_--;
+        return true;
+
+      case State::kFailed:
+        return false;
+    }
+  }
+}
+
+bool DeltaPatch::ReadField(LzDecoder& input, size_t length) {
+  while (field_length_ < length) {
+    if (!input.Next(&field_[field_length_])) {
+      return false;
+    }
+    field_length_++;
+  }
+  return true;
+}
+
+uint16_t DeltaPatch::FieldU16(size_t offset) const {
+  return field_[offset] | field_[offset + 1] << 8;
+}
+
+void DeltaPatch::CheckHeader() {
+  field_length_ = 0;
+
+  uint32_t magic = FieldU16(0) | static_cast<uint32_t>(FieldU16(2)) << 16;
+  uint8_t digest[32];
+  if (magic != kMagic || !bootloader_.RunningImageDigest(digest) ||
+      memcmp(digest, &field_[4], sizeof(digest)) != 0) {
+    state_ = State::kFailed;
+    return;
+  }
+
+  state_ = State::kOp;
+}
+
+void DeltaPatch::StartOp() {
+  field_length_ = 0;
+
+  switch (field_[0]) {
+    case kCopy:
+      copy_offset_ = FieldU16(1);
+      remaining_ = FieldU16(3);
+      copy_chunk_pos_ = 0;
+      copy_chunk_length_ = 0;
+      state_ = State::kCopy;
+      break;
+
+    case kInsert:
+      remaining_ = FieldU16(1);
+      state_ = State::kInsert;
+      break;
+
+    default:
+      state_ = State::kFailed;
+      break;
+  }
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef DELTA_PATCH_H_
+#define DELTA_PATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bootloader_interface.h"
+#include "lz_decoder.h"
+
+// Rebuilds an update image from the running image and a patch created by
+// scripts/mcuboot_patch.py.
+//
+// The patch starts with a magic number and the SHA-256 of the image it was
+// created against. A sequence of operations follows:
+//   kCopy, offset (u16), length (u16): Copy bytes of the running image.
+//   kInsert, length (u16), data: Insert the following bytes.
+// All numbers are little endian. The patch itself is LZ compressed.
+class DeltaPatch {
+ public:
+  static constexpr uint32_t kMagic = 0x50555353;  // "SSUP"
+
+  enum Op : uint8_t {
+    kCopy = 0,
+    kInsert,
+  };
+
+  explicit DeltaPatch(BootloaderInterface& bootloader)
+      : bootloader_(bootloader) {}
+
+  void Reset();
+
+  // Rebuilds the next byte of the image with the patch read from input.
+  // Returns false when more input is required or the patch was rejected.
+  bool Next(LzDecoder& input, uint8_t* byte);
+
+  // The patch does not belong to the running image or is corrupted.
+  bool failed() const { return state_ == State::kFailed; }
+
+ private:
+  enum class State {
+    kHeader,
+    kOp,
+    kCopy,
+    kInsert,
+    kFailed,
+  };
+
+  static constexpr size_t kHeaderSize = 4 + 32;
+
+  // Copies read the running image in chunks of this size.
+  static constexpr size_t kCopyChunkSize = 32;
+
+  // Reads from input until the field holds length bytes.
+  bool ReadField(LzDecoder& input, size_t length);
+  uint16_t FieldU16(size_t offset) const;
+
+  void CheckHeader();
+  void StartOp();
+
+  BootloaderInterface& bootloader_;
+
+  State state_ = State::kHeader;
+  uint8_t field_[kHeaderSize];
+  size_t field_length_ = 0;
+
+  size_t copy_offset_ = 0;
+  size_t remaining_ = 0;  // Bytes of the current operation.
+
+  uint8_t copy_chunk_[kCopyChunkSize];
+  size_t copy_chunk_pos_ = 0;
+  size_t copy_chunk_length_ = 0;
+};
+
+#endif  // DELTA_PATCH_H_
@@ -0,0 +1,73 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "lz_decoder.h"
+
+constexpr size_t LzDecoder::kWindowSize;
+constexpr size_t LzDecoder::kInputSize;
+constexpr size_t LzDecoder::kMinMatch;
+
+void LzDecoder::Reset() {
+  input_start_ = 0;
+  input_count_ = 0;
+  window_pos_ = 0;
+  flags_ = 0;
+  items_left_ = 0;
+  match_left_ = 0;
+}
+
+bool LzDecoder::Push(uint8_t byte) {
+  if (input_count_ == kInputSize) {
+    return false;
+  }
+
+  input_[(input_start_ + input_count_) % kInputSize] = byte;
+  input_count_++;
+  return true;
+}
+
+bool LzDecoder::Next(uint8_t *byte) {
+  if (match_left_ == 0) {
+    if (items_left_ == 0) {
+      if (input_count_ < 1) {
+        return false;
+      }
+      flags_ = Pop();
+      items_left_ = 8;
+    }
+
+    bool literal = flags_ & 1;
+    if (input_count_ < (literal ? 1u : 2u)) {
+      return false;
+    }
+    flags_ >>= 1;
+    items_left_--;
+
+    if (literal) {
+      *byte = Pop();
+      Emit(*byte);
+      return true;
+    }
+
+    match_distance_ = Pop() + 1u;
+    match_left_ = Pop() + kMinMatch;
+  }
+
+  // The distance never exceeds the window size so the referenced byte is read
+  // before it is overwritten.
+  *byte = window_[(window_pos_ - match_distance_) % kWindowSize];
+  Emit(*byte);
+  match_left_--;
+  return true;
+}
+
+uint8_t LzDecoder::Pop() {
+  uint8_t byte = input_[input_start_];
+  input_start_ = (input_start_ + 1) % kInputSize;
+  input_count_--;
+  return byte;
+}
+
+void LzDecoder::Emit(uint8_t byte) {
+  window_[window_pos_ % kWindowSize] = byte;
+  window_pos_++;
+}
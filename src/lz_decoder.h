@@ -0,0 +1,50 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef LZ_DECODER_H_
+#define LZ_DECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming decoder for the LZSS format of scripts/lz_compress.py.
+//
+// The stream is a sequence of groups: one flag byte followed by eight items.
+// Flag bit 0 describes the first item. A set bit is a literal byte, a cleared
+// bit a back reference of two bytes: distance - 1 and length - 3. References
+// reach back up to 256 bytes so that the window is small enough for RAM.
+class LzDecoder {
+ public:
+  static constexpr size_t kWindowSize = 256;
+  static constexpr size_t kInputSize = 256;
+  static constexpr size_t kMinMatch = 3;
+
+  void Reset();
+
+  // Queues compressed data. Returns false when the input buffer is full.
+  bool Push(uint8_t byte);
+
+  // Free space of the input buffer.
+  size_t space() const { return kInputSize - input_count_; }
+
+  // Decompresses the next byte. Returns false when more input is required.
+  bool Next(uint8_t *byte);
+
+ private:
+  uint8_t Pop();
+  void Emit(uint8_t byte);
+
+  uint8_t input_[kInputSize];
+  size_t input_start_ = 0;
+  size_t input_count_ = 0;
+
+  uint8_t window_[kWindowSize] = {};
+  size_t window_pos_ = 0;
+
+  uint8_t flags_ = 0;
+  uint8_t items_left_ = 0;  // Items described by flags_.
+
+  size_t match_distance_ = 0;
+  size_t match_left_ = 0;
+};
+
+#endif  // LZ_DECODER_H_
@@ -8,24 +8,126 @@
 #include "modbus/slave.h"
 #include "modbus_data.h"
 #include "modbus_data_fw_update.h"
+#include "scheduler.h"
 
 namespace {
 
-void UpdateModbus(modbus::RtuProtocol &rtu, modbus::Slave &slave) {
-  BspInterruptFree _;
+enum TaskId : size_t {
+  kTaskModbus,
+  kTaskSample,
+  kTaskSweep,
+  kTaskCapture,
+  kTaskReset,
+  kTaskFlash,
+  kNumTasks,
+};
+
+// Time between checks for the end of a transmission.
+constexpr uint32_t kTxPollMs = 1;
+
+struct Application {
+  modbus::RtuProtocol &rtu;
+  modbus::Slave &slave;
+  ModbusData &data;
+  ModbusDataFwUpdate &fw_update;
+  uint16_t sample_interval;
+};
+
+// Posts the tasks requested by MODBUS writes.
+void ScheduleRequests(Scheduler &scheduler, Application &app) {
+  if (app.data.sample_interval() != app.sample_interval) {
+    app.sample_interval = app.data.sample_interval();
+    if (app.sample_interval > 0) {
+      scheduler.PostAfter(kTaskSample, app.sample_interval * 1000u);
+    } else {
+      scheduler.Cancel(kTaskSample);
+    }
+  }
+
+  if (app.data.sweep_requested()) {
+    scheduler.Post(kTaskSweep);
+  }
+
+  if (app.data.capture_requested()) {
+    scheduler.Post(kTaskCapture);
+  }
+
+  if (app.data.reset()) {
+    scheduler.Post(kTaskReset);
+  }
+
+  if (app.fw_update.write_pending()) {
+    scheduler.Post(kTaskFlash);
+  }
+}
+
+void RunModbus(Scheduler &scheduler, void *context) {
+  Application &app = *static_cast<Application *>(context);
+
+  {
+    BspInterruptFree _;
+
+    auto req = app.rtu.ReadFrame();
+    if (req == nullptr) {
+      return;
+    }
+
+    modbus::Buffer resp;
+    bool ok = app.slave.Execute(req, &resp);
+    if (ok) {
+      app.rtu.WriteFrame(&resp);
+    }
+  }
+
+  ScheduleRequests(scheduler, app);
+}
+
+// Measurements run with interrupts enabled so that frames keep arriving in the
+// background. ModbusData is only accessed from tasks.
+void RunSample(Scheduler &scheduler, void *context) {
+  Application &app = *static_cast<Application *>(context);
+  app.data.Sample();
+  scheduler.PostAfter(kTaskSample, app.sample_interval * 1000u);
+}
+
+void RunSweep(Scheduler &, void *context) {
+  Application &app = *static_cast<Application *>(context);
+  app.data.Sweep();
+}
 
-  auto req = rtu.ReadFrame();
-  if (req == nullptr) {
+void RunCapture(Scheduler &, void *context) {
+  Application &app = *static_cast<Application *>(context);
+  app.data.Capture();
+}
+
+void RunReset(Scheduler &scheduler, void *) {
+  if (modbus_serial.tx_active()) {
+    scheduler.PostAfter(kTaskReset, kTxPollMs);
     return;
   }
 
-  modbus::Buffer resp;
-  bool ok = slave.Execute(req, &resp);
-  if (!ok) {
+  BspReset();
+}
+
+// Programs the firmware update data with the bus still receiving.
+void RunFlash(Scheduler &scheduler, void *context) {
+  Application &app = *static_cast<Application *>(context);
+
+  // Only reception works while the flash is busy.
+  if (modbus_serial.tx_active()) {
+    scheduler.PostAfter(kTaskFlash, kTxPollMs);
     return;
   }
 
-  rtu.WriteFrame(&resp);
+  {
+    BspFlashBusy _(static_cast<uint8_t>(app.slave.address()));
+    app.fw_update.WritePending();
+  }
+
+  // The other buffer filled up in the meantime.
+  if (app.fw_update.write_pending()) {
+    scheduler.Post(kTaskFlash);
+  }
 }
 
 }  // namespace
@@ -34,6 +136,7 @@ int main() {
   BspSetup();
 
   modbus_serial.Init(CONFIG_BAUDRATE);
+  system_clock.AddListener(&modbus_serial);
 
   // Must be called after uart init to prevent glitches on the DE pin
   // for the RS485 transceiver.
@@ -42,7 +145,6 @@ int main() {
   // Link global serial interface implementation to protocol.
   modbus::RtuProtocol modbus_rtu(modbus_serial);
   modbus_serial.set_modbus_rtu(&modbus_rtu);
-  modbus_serial.Enable();
 
   ModbusDataFwUpdate fw_update(bootloader);
   ModbusData modbus_data(fw_update);
@@ -50,14 +152,25 @@ int main() {
   modbus::Slave modbus_slave(modbus_data);
   modbus_slave.set_address(CONFIG_SENSOR_ID);
 
-  // Main loop.
-  for (;;) {
-    UpdateModbus(modbus_rtu, modbus_slave);
-
-    if (modbus_data.reset() && !modbus_serial.tx_active()) {
-      BspReset();
-    }
+  Application app = {modbus_rtu, modbus_slave, modbus_data, fw_update, 0};
+  const Scheduler::Task tasks[kNumTasks] = {
+      {RunModbus, &app},   // kTaskModbus
+      {RunSample, &app},   // kTaskSample
+      {RunSweep, &app},    // kTaskSweep
+      {RunCapture, &app},  // kTaskCapture
+      {RunReset, &app},    // kTaskReset
+      {RunFlash, &app},    // kTaskFlash
+  };
+  Scheduler scheduler(platform, tasks, kNumTasks);
+  scheduler.set_residency(&residency);
+
+  // Start the background sampling with the stored interval.
+  ScheduleRequests(scheduler, app);
+
+  modbus_serial.set_frame_task(&scheduler, kTaskModbus);
+  modbus_serial.Enable();
 
-    BspSleep();
+  for (;;) {
+    scheduler.RunOnce();
   }
 }
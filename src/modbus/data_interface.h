@@ -13,8 +13,9 @@ class DataInterface {
  public:
   virtual ~DataInterface() = default;
 
-  // Called when starting to process modbus data.
-  virtual void Start(FunctionCode fn_code) = 0;
+  // Called when starting to process modbus data. Broadcast requests are
+  // executed by all slaves on the bus and never answered.
+  virtual void Start(FunctionCode fn_code, bool broadcast) = 0;
 
   // Called when modbus data processing is finishd.
   virtual void Complete() = 0;
@@ -24,10 +25,27 @@ class DataInterface {
   // code in case of failure.
   virtual ExceptionCode ReadRegister(uint16_t address, uint16_t *data_out) = 0;
 
+  // Reads the state of a discrete input at address and writes it to data_out.
+  // Returns ExceptionCode::kOk on success or any other (positive) exception
+  // code in case of failure.
+  virtual ExceptionCode ReadDiscreteInput(uint16_t address, bool *data_out) = 0;
+
   // Write data to a register.
   // Returns ExceptionCode::kOk on success or any other (positive) exception
   // code in case of failure.
   virtual ExceptionCode WriteRegister(uint16_t address, uint16_t data) = 0;
+
+  // Reads the register at record number of a file and writes it to data_out.
+  // Returns ExceptionCode::kOk on success or any other (positive) exception
+  // code in case of failure.
+  virtual ExceptionCode ReadFileRecord(uint16_t file, uint16_t record,
+                                       uint16_t *data_out) = 0;
+
+  // Write data to the register at record number of a file.
+  // Returns ExceptionCode::kOk on success or any other (positive) exception
+  // code in case of failure.
+  virtual ExceptionCode WriteFileRecord(uint16_t file, uint16_t record,
+                                        uint16_t data) = 0;
 };
 
 }  // namespace modbus
@@ -10,9 +10,12 @@ namespace modbus {
 using Buffer = etl::vector<uint8_t, 256>;
 
 enum class FunctionCode {
+  kReadDiscreteInputs = 2,
   kReadInputRegister = 4,
   kWriteSingleRegister = 6,
   kWriteMultipleRegisters = 16,
+  kReadFileRecord = 20,
+  kWriteFileRecord = 21,
 };
 
 enum class ExceptionCode {
@@ -21,6 +24,9 @@ enum class ExceptionCode {
   kIllegalFunction,
   kIllegalDataAddress,
   kIllegalDataValue,
+  kSlaveDeviceFailure,
+  kAcknowledge,
+  kSlaveDeviceBusy,
 };
 
 }  // namespace modbus
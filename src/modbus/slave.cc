@@ -2,6 +2,36 @@
 
 namespace modbus {
 
+constexpr uint8_t Slave::kBroadcastAddress;
+
+namespace {
+
+// The only reference type of file record requests.
+constexpr uint8_t kFileReferenceType = 6;
+
+// Records 0 to 9999 of files 1 to 65535 are addressable.
+constexpr uint16_t kNumRecords = 10000;
+
+// Size of the reference type, file number, record number and record length.
+constexpr size_t kSubRequestSize = 7;
+
+bool IsValidRecordRange(uint8_t reference_type, uint16_t file,
+                        uint16_t record, uint16_t length) {
+  return reference_type == kFileReferenceType && file != 0 &&
+         record < kNumRecords && length <= kNumRecords - record;
+}
+
+// Busy is passed on so that the master retries later. Other errors of the
+// data interface are reported as illegal address.
+ExceptionCode DataException(ExceptionCode exception) {
+  if (exception == ExceptionCode::kSlaveDeviceBusy) {
+    return exception;
+  }
+  return ExceptionCode::kIllegalDataAddress;
+}
+
+}  // namespace
+
 bool Slave::Execute(const Buffer* req_buffer, Buffer* resp_buffer) {
   // const_cast: No modifying methods like bit_stream.put() can be used.
   etl::bit_stream request(const_cast<uint8_t*>(req_buffer->begin()),
@@ -12,11 +42,12 @@ bool Slave::Execute(const Buffer* req_buffer, Buffer* resp_buffer) {
   resp_buffer->resize(resp_buffer->capacity());
   etl::bit_stream response(resp_buffer->data(), resp_buffer->size());
 
-  // TODO: Allow broadcasts (addr = 0)
   uint8_t addr;
-  if (!request.get<uint8_t>(addr) || addr != address_) {
+  if (!request.get<uint8_t>(addr) ||
+      (addr != address_ && addr != kBroadcastAddress)) {
     return false;
   }
+  bool broadcast = addr == kBroadcastAddress;
   response.put(addr);
 
   uint8_t fn_code;
@@ -27,8 +58,20 @@ bool Slave::Execute(const Buffer* req_buffer, Buffer* resp_buffer) {
 
   ExceptionCode exception = ExceptionCode::kOk;
   FunctionCode fnc = static_cast<FunctionCode>(fn_code);
-  data_.Start(fnc);
+
+  // Only writes are allowed as broadcast.
+  if (broadcast && fnc != FunctionCode::kWriteSingleRegister &&
+      fnc != FunctionCode::kWriteMultipleRegisters &&
+      fnc != FunctionCode::kWriteFileRecord) {
+    return false;
+  }
+
+  data_.Start(fnc, broadcast);
   switch (fnc) {
+    case FunctionCode::kReadDiscreteInputs:
+      exception = ReadDiscreteInputs(request, response);
+      break;
+
     case FunctionCode::kReadInputRegister:
       exception = ReadInputRegister(request, response);
       break;
@@ -41,6 +84,14 @@ bool Slave::Execute(const Buffer* req_buffer, Buffer* resp_buffer) {
       exception = WriteMultipleRegisters(request, response);
       break;
 
+    case FunctionCode::kReadFileRecord:
+      exception = ReadFileRecord(request, response);
+      break;
+
+    case FunctionCode::kWriteFileRecord:
+      exception = WriteFileRecord(request, response);
+      break;
+
     default:
       // Function code is not supported: Reply with an exception frame.
       exception = ExceptionCode::kIllegalFunction;
@@ -49,6 +100,10 @@ bool Slave::Execute(const Buffer* req_buffer, Buffer* resp_buffer) {
 
   data_.Complete();
 
+  if (broadcast) {
+    return false;
+  }
+
   if (exception == ExceptionCode::kOk) {
     if (!request.at_end()) {
       // Additional bytes at the end make a frame invalid.
@@ -70,6 +125,46 @@ bool Slave::Execute(const Buffer* req_buffer, Buffer* resp_buffer) {
   return true;
 }
 
+ExceptionCode Slave::ReadDiscreteInputs(etl::bit_stream& req,
+                                        etl::bit_stream& resp) {
+  uint16_t starting_addr;
+  if (!req.get<uint16_t>(starting_addr)) {
+    return ExceptionCode::kInvalidFrame;
+  }
+
+  uint16_t quantity_inputs;
+  if (!req.get<uint16_t>(quantity_inputs)) {
+    return ExceptionCode::kInvalidFrame;
+  }
+
+  // Maximum number of inputs allowed per spec.
+  // This check also prevents buffer overflow of the response buffer.
+  if (quantity_inputs < 1 || quantity_inputs > 0x7D0) {
+    return ExceptionCode::kIllegalDataValue;
+  }
+
+  resp.put<uint8_t>((quantity_inputs + 7) / 8);  // Byte Count
+
+  // Pack the requested inputs into bytes, first input in the LSB.
+  uint8_t input_status = 0;
+  for (int i = 0; i < quantity_inputs; i++) {
+    bool input = false;
+    uint16_t addr = starting_addr + i;
+    ExceptionCode exception = data_.ReadDiscreteInput(addr, &input);
+    if (exception != ExceptionCode::kOk) {
+      return DataException(exception);
+    }
+
+    input_status |= input << (i % 8);
+    if (i % 8 == 7 || i == quantity_inputs - 1) {
+      resp.put(input_status);
+      input_status = 0;
+    }
+  }
+
+  return ExceptionCode::kOk;
+}
+
 ExceptionCode Slave::ReadInputRegister(etl::bit_stream& req,
                                        etl::bit_stream& resp) {
   uint16_t starting_addr;
@@ -96,7 +191,7 @@ ExceptionCode Slave::ReadInputRegister(etl::bit_stream& req,
     uint16_t addr = starting_addr + i;
     ExceptionCode exception = data_.ReadRegister(addr, &reg_content);
     if (exception != ExceptionCode::kOk) {
-      return ExceptionCode::kIllegalDataAddress;
+      return DataException(exception);
     }
 
     resp.put(reg_content);
@@ -119,7 +214,7 @@ ExceptionCode Slave::WriteSingleRegister(etl::bit_stream& req,
 
   ExceptionCode exception = data_.WriteRegister(wr_addr, wr_data);
   if (exception != ExceptionCode::kOk) {
-    return ExceptionCode::kIllegalDataAddress;
+    return DataException(exception);
   }
 
   resp.put(wr_addr);
@@ -159,7 +254,7 @@ ExceptionCode Slave::WriteMultipleRegisters(etl::bit_stream& req,
 
     ExceptionCode exception = data_.WriteRegister(addr, reg_value);
     if (exception != ExceptionCode::kOk) {
-      return ExceptionCode::kIllegalDataAddress;
+      return DataException(exception);
     }
   }
 
@@ -168,4 +263,124 @@ ExceptionCode Slave::WriteMultipleRegisters(etl::bit_stream& req,
   return ExceptionCode::kOk;
 }
 
+ExceptionCode Slave::ReadFileRecord(etl::bit_stream& req,
+                                    etl::bit_stream& resp) {
+  uint8_t byte_count;
+  if (!req.get<uint8_t>(byte_count)) {
+    return ExceptionCode::kInvalidFrame;
+  }
+
+  if (byte_count < kSubRequestSize || byte_count > 0xF5 ||
+      byte_count % kSubRequestSize != 0) {
+    return ExceptionCode::kIllegalDataValue;
+  }
+  size_t num_sub_requests = byte_count / kSubRequestSize;
+
+  // The response length precedes the data. Look ahead at the requested
+  // lengths, which also prevents buffer overflow of the response buffer.
+  etl::bit_stream look_ahead = req;
+  size_t resp_length = 0;
+  for (size_t i = 0; i < num_sub_requests; i++) {
+    uint8_t reference_type;
+    uint16_t file, record, length;
+    if (!look_ahead.get<uint8_t>(reference_type) ||
+        !look_ahead.get<uint16_t>(file) || !look_ahead.get<uint16_t>(record) ||
+        !look_ahead.get<uint16_t>(length)) {
+      return ExceptionCode::kInvalidFrame;
+    }
+    resp_length += 2 + 2 * length;
+  }
+
+  if (resp_length > 0xF5) {
+    return ExceptionCode::kIllegalDataValue;
+  }
+  resp.put<uint8_t>(resp_length);  // Response Data Length
+
+  for (size_t i = 0; i < num_sub_requests; i++) {
+    uint8_t reference_type;
+    uint16_t file, record, length;
+    req.get<uint8_t>(reference_type);
+    req.get<uint16_t>(file);
+    req.get<uint16_t>(record);
+    req.get<uint16_t>(length);
+
+    if (!IsValidRecordRange(reference_type, file, record, length)) {
+      return ExceptionCode::kIllegalDataAddress;
+    }
+
+    resp.put<uint8_t>(1 + 2 * length);  // File Response Length
+    resp.put(reference_type);
+
+    for (uint16_t j = 0; j < length; j++) {
+      uint16_t record_data = 0;
+      ExceptionCode exception =
+          data_.ReadFileRecord(file, record + j, &record_data);
+      if (exception != ExceptionCode::kOk) {
+        return DataException(exception);
+      }
+
+      resp.put(record_data);
+    }
+  }
+
+  return ExceptionCode::kOk;
+}
+
+ExceptionCode Slave::WriteFileRecord(etl::bit_stream& req,
+                                     etl::bit_stream& resp) {
+  uint8_t length;
+  if (!req.get<uint8_t>(length)) {
+    return ExceptionCode::kInvalidFrame;
+  }
+
+  if (length < kSubRequestSize + 2 || length > 0xFB) {
+    return ExceptionCode::kIllegalDataValue;
+  }
+
+  // The response echoes the request.
+  resp.put(length);  // Request Data Length
+
+  size_t remaining = length;
+  while (remaining > 0) {
+    uint8_t reference_type;
+    uint16_t file, record, record_length;
+    if (!req.get<uint8_t>(reference_type) || !req.get<uint16_t>(file) ||
+        !req.get<uint16_t>(record) || !req.get<uint16_t>(record_length)) {
+      return ExceptionCode::kInvalidFrame;
+    }
+
+    size_t sub_request_size = kSubRequestSize + 2 * record_length;
+    if (sub_request_size > remaining) {
+      return ExceptionCode::kIllegalDataValue;
+    }
+    remaining -= sub_request_size;
+
+    if (!IsValidRecordRange(reference_type, file, record, record_length)) {
+      return ExceptionCode::kIllegalDataAddress;
+    }
+
+    resp.put(reference_type);
+    resp.put(file);
+    resp.put(record);
+    resp.put(record_length);
+
+    for (uint16_t j = 0; j < record_length; j++) {
+      uint16_t record_data;
+      if (!req.get<uint16_t>(record_data)) {
+        return ExceptionCode::kInvalidFrame;
+      }
+
+      ExceptionCode exception =
+          data_.WriteFileRecord(file, record + j, record_data);
+      if (exception != ExceptionCode::kOk) {
+        return DataException(exception);
+      }
+
+      resp.put(record_data);
+    }
+  }
+
+  return ExceptionCode::kOk;
+}
+
 }  // namespace modbus
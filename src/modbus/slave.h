@@ -17,6 +17,9 @@ namespace modbus {
 // data interface.
 class Slave {
  public:
+  // Write requests to this address are executed without a response.
+  static constexpr uint8_t kBroadcastAddress = 0;
+
   explicit Slave(DataInterface& data) : address_(-1), data_(data) {}
 
   // Processes a request and creates a response.
@@ -30,11 +33,15 @@ class Slave {
   }
 
  private:
+  ExceptionCode ReadDiscreteInputs(etl::bit_stream& req,
+                                   etl::bit_stream& resp);
   ExceptionCode ReadInputRegister(etl::bit_stream& req, etl::bit_stream& resp);
   ExceptionCode WriteSingleRegister(etl::bit_stream& req,
                                     etl::bit_stream& resp);
   ExceptionCode WriteMultipleRegisters(etl::bit_stream& req,
                                        etl::bit_stream& resp);
+  ExceptionCode ReadFileRecord(etl::bit_stream& req, etl::bit_stream& resp);
+  ExceptionCode WriteFileRecord(etl::bit_stream& req, etl::bit_stream& resp);
 
   int address_;
   DataInterface& data_;
@@ -2,16 +2,69 @@
 
 #include "modbus_data.h"
 
+#include "boot_stats.h"
 #include "version.h"
 
-void ModbusData::Complete() { measurement_available_ = false; }
+ModbusData::ModbusData(modbus::DataInterface &fw_update)
+    : fw_update_(fw_update) {
+  if (!BspLoadSettings(&settings_)) {
+    settings_ = kDefaultSettings;
+  }
+
+  BspSetAlarmThresholds(settings_.alarm_threshold_low,
+                        settings_.alarm_threshold_high);
+  platform.SetDeepSleep(settings_.deep_sleep);
+}
+
+void ModbusData::Complete() {
+  // Measure again for the next request unless the background sampler keeps
+  // the measurement up to date.
+  if (settings_.sample_interval == 0) {
+    measurement_available_ = false;
+  }
+}
+
+void ModbusData::Sample() {
+  Measure();
+
+  if (sweep_mode_ == kSweepContinuous) {
+    Sweep();
+  }
+}
+
+void ModbusData::Sweep() {
+  if (settings_.sweep_num_points > 0) {
+    BspMeasureSweep(settings_.sweep_reloads, sweep_results_,
+                    settings_.sweep_num_points);
+  }
+
+  if (sweep_mode_ == kSweepOnce) {
+    sweep_mode_ = kSweepOff;
+  }
+}
+
+void ModbusData::Capture() {
+  capture_state_ =
+      BspCaptureRaw(capture_interval_us_) ? kCaptureIdle : kCaptureFailed;
+}
+
+void ModbusData::Measure() {
+  measurement_ = BspMeasureRaw();
+  measurement_available_ = true;
+
+  uint16_t raw = measurement_.high - measurement_.low + measurement_.diodes;
+  temperature_ = settings_.compensation.Temperature(measurement_.diodes);
+  compensated_ = settings_.compensation.Apply(raw, temperature_);
+}
 
 modbus::ExceptionCode ModbusData::ReadRegister(uint16_t address,
                                                uint16_t *data_out) {
-  if (address < 4) {
+  // Firmware update is mapped to the second half of the address range.
+  if (address >= 0x8000) {
+    return fw_update_.ReadRegister(address - 0x8000, data_out);
+  } else if (address < 7) {
     if (!measurement_available_) {
-      measurement_ = BspMeasureRaw();
-      measurement_available_ = true;
+      Measure();
     }
 
     switch (address) {
@@ -31,14 +84,146 @@ modbus::ExceptionCode ModbusData::ReadRegister(uint16_t address,
         *data_out = measurement_.diodes;
         break;
 
+      case 4:
+        // Volumetric water content in 0.01%.
+        *data_out = settings_.calibration.Apply(compensated_);
+        break;
+
+      case 5:
+        // Temperature in 0.01°C, 0x8000 when not configured.
+        *data_out = temperature_;
+        break;
+
+      case 6:
+        *data_out = compensated_;
+        break;
+
       default:
         assert(false);
         break;
     }
+  } else if (address == 0x10) {
+    *data_out = BspAlarms();
+  } else if (address == 0x11) {
+    *data_out = settings_.alarm_threshold_low;
+  } else if (address == 0x12) {
+    *data_out = settings_.alarm_threshold_high;
+  } else if (address == 0x13) {
+    *data_out = settings_.sample_interval;
+  } else if (address == 0x14) {
+    *data_out = settings_.deep_sleep;
+  } else if (address == 0x15) {
+    *data_out = platform.wakeups();
   } else if (address == 0x80) {
     *data_out = (VERSION_MAJOR << 8) | VERSION_MINOR;
   } else if (address == 0x100) {
     *data_out = reset_;
+  } else if (address == 0x101) {
+    *data_out = 0;
+  } else if (address == 0x200) {
+    *data_out = settings_.calibration.num_points;
+  } else if (address > 0x200 &&
+             address <= 0x200 + 2 * Calibration::kMaxPoints) {
+    // Calibration points as (raw, vwc) register pairs.
+    const CalibrationPoint &p =
+        settings_.calibration.points[(address - 0x201) / 2];
+    *data_out = (address % 2) ? p.raw : p.vwc;
+  } else if (address == 0x220) {
+    *data_out = settings_.compensation.diode_ref;
+  } else if (address == 0x221) {
+    *data_out = settings_.compensation.temperature_ref;
+  } else if (address == 0x222) {
+    *data_out = settings_.compensation.temperature_slope;
+  } else if (address == 0x223) {
+    *data_out = settings_.compensation.raw_slope;
+  } else if (address == 0x300) {
+    *data_out = sweep_mode_;
+  } else if (address == 0x301) {
+    *data_out = settings_.sweep_num_points;
+  } else if (address >= 0x302 && address < 0x302 + kMaxSweepPoints) {
+    *data_out = settings_.sweep_reloads[address - 0x302];
+  } else if (address >= 0x310 && address < 0x310 + 3 * kMaxSweepPoints) {
+    // Sweep results as (low, high, diodes) register triples.
+    const RawMeasurement &rm = sweep_results_[(address - 0x310) / 3];
+    switch ((address - 0x310) % 3) {
+      case 0:
+        *data_out = rm.low;
+        break;
+
+      case 1:
+        *data_out = rm.high;
+        break;
+
+      default:
+        *data_out = rm.diodes;
+        break;
+    }
+  } else if (address == 0x400) {
+    *data_out = capture_state_;
+  } else if (address == 0x401) {
+    *data_out = capture_interval_us_;
+  } else if (address == 0x402) {
+    *data_out = BspCaptureLength();
+  } else if (address >= 0x500 && address < 0x506) {
+    // Clock switching statistics.
+    const SystemClock::Stats &stats = system_clock.stats();
+    const uint16_t values[] = {
+        stats.pll_starts,  stats.pll_reuses,      stats.last_lock_us,
+        stats.max_lock_us, stats.last_request_us, stats.last_release_us,
+    };
+    *data_out = values[address - 0x500];
+  } else if (address == 0x510) {
+    *data_out = BspFlashBusyDroppedFrames();
+  } else if (address >= 0x600 && address < 0x600 + 2 * Residency::kNumStates) {
+    // Residency counters in ms as (high, low) register pairs. Reading the high
+    // word latches the low word so that the pair is consistent.
+    if (address % 2 == 0) {
+      uint32_t total = residency.Total(
+          static_cast<Residency::State>((address - 0x600) / 2));
+      residency_low_ = total & 0xFFFF;
+      *data_out = total >> 16;
+    } else {
+      *data_out = residency_low_;
+    }
+  } else if (address == 0x610) {
+    *data_out = 0;
+  } else if (address >= 0x620 && address < 0x62B) {
+    // Flash operations of the last boot in ms, per area (slot 0, slot 1,
+    // scratch). All zero when the bootloader did not record them.
+    BootStats stats = {};
+    if (boot_stats.magic == BootStats::kMagic) {
+      stats = boot_stats;
+    }
+    const uint16_t values[] = {
+        static_cast<uint16_t>(stats.swap_type),
+        static_cast<uint16_t>(stats.boot_us / 1000),
+        static_cast<uint16_t>(stats.erase_us[BootStats::kSlot0] / 1000),
+        static_cast<uint16_t>(stats.erase_us[BootStats::kSlot1] / 1000),
+        static_cast<uint16_t>(stats.erase_us[BootStats::kScratch] / 1000),
+        static_cast<uint16_t>(stats.program_us[BootStats::kSlot0] / 1000),
+        static_cast<uint16_t>(stats.program_us[BootStats::kSlot1] / 1000),
+        static_cast<uint16_t>(stats.program_us[BootStats::kScratch] / 1000),
+        stats.erases[BootStats::kSlot0],
+        stats.erases[BootStats::kSlot1],
+        stats.erases[BootStats::kScratch],
+    };
+    *data_out = values[address - 0x620];
+  } else if (address >= 0x1000 && address < 0x1000 + kCaptureSamples) {
+    // Captured values as (low, high, diodes) register triples.
+    *data_out = BspCaptureSample(address - 0x1000);
+  } else {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  return modbus::ExceptionCode::kOk;
+}
+
+modbus::ExceptionCode ModbusData::ReadDiscreteInput(uint16_t address,
+                                                    bool *data_out) {
+  if (address == 0) {
+    *data_out = BspAlarms() & kAlarmBelowLow;
+  } else if (address == 1) {
+    *data_out = BspAlarms() & kAlarmAboveHigh;
   } else {
     return modbus::ExceptionCode::kIllegalDataAddress;
   }
@@ -51,8 +236,97 @@ modbus::ExceptionCode ModbusData::WriteRegister(uint16_t address,
   // Firmware update is mapped to the second half of the address range.
   if (address >= 0x8000) {
     return fw_update_.WriteRegister(address - 0x8000, data);
+  } else if (broadcast_) {
+    // Only the firmware update is distributed to all nodes at once. Settings
+    // like the slave address must stay individual.
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  } else if (address == 0x10) {
+    // Any write acknowledges the latched alarms.
+    BspClearAlarms();
+  } else if (address == 0x11 || address == 0x12) {
+    // Thresholds are compared against the raw moisture channel (register 1).
+    // low > high would latch both alarms on every sample. To move the window
+    // write the threshold in the direction of the move first.
+    if (data > 0xFFF ||
+        (address == 0x11 && data > settings_.alarm_threshold_high) ||
+        (address == 0x12 && data < settings_.alarm_threshold_low)) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+    if (address == 0x11) {
+      settings_.alarm_threshold_low = data;
+    } else {
+      settings_.alarm_threshold_high = data;
+    }
+    BspSetAlarmThresholds(settings_.alarm_threshold_low,
+                          settings_.alarm_threshold_high);
+  } else if (address == 0x13) {
+    settings_.sample_interval = data;
+  } else if (address == 0x14) {
+    // Deep sleep idle mode, off (0) by default and not meant to be enabled
+    // in the field yet: The wakeup latency and the idle current were not
+    // measured on hardware. The first frame after each wakeup is lost and
+    // only the MODBUS master retry delivers it.
+    settings_.deep_sleep = data;
+    platform.SetDeepSleep(settings_.deep_sleep);
   } else if (address == 0x100) {
     reset_ = data;
+  } else if (address == 0x101) {
+    // Write 1 to store the current settings in flash.
+    if (data != 1 || !BspStoreSettings(settings_)) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+  } else if (address == 0x200) {
+    // The curve is validated when applied because all points are written one
+    // register at a time.
+    if (data > Calibration::kMaxPoints) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+    settings_.calibration.num_points = data;
+  } else if (address > 0x200 &&
+             address <= 0x200 + 2 * Calibration::kMaxPoints) {
+    CalibrationPoint &p = settings_.calibration.points[(address - 0x201) / 2];
+    if (address % 2) {
+      p.raw = data;
+    } else {
+      p.vwc = data;
+    }
+  } else if (address == 0x220) {
+    settings_.compensation.diode_ref = data;
+  } else if (address == 0x221) {
+    settings_.compensation.temperature_ref = data;
+  } else if (address == 0x222) {
+    settings_.compensation.temperature_slope = data;
+  } else if (address == 0x223) {
+    settings_.compensation.raw_slope = data;
+  } else if (address == 0x300) {
+    if (data > kSweepContinuous) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+    sweep_mode_ = data;
+  } else if (address == 0x301) {
+    if (data > kMaxSweepPoints) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+    settings_.sweep_num_points = data;
+  } else if (address >= 0x302 && address < 0x302 + kMaxSweepPoints) {
+    settings_.sweep_reloads[address - 0x302] = data;
+  } else if (address == 0x400) {
+    // Write 1 to request a capture.
+    if (data != kCaptureRequested) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+    capture_state_ = data;
+  } else if (address == 0x401) {
+    if (data > kMaxCaptureIntervalUs) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+    capture_interval_us_ = data;
+  } else if (address == 0x610) {
+    // Write 1 to reset the residency counters.
+    if (data != 1) {
+      return modbus::ExceptionCode::kIllegalDataValue;
+    }
+    residency.Reset();
   } else {
     return modbus::ExceptionCode::kIllegalDataAddress;
   }
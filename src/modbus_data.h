@@ -5,26 +5,87 @@
 
 #include "bsp/bsp.h"
 #include "modbus/data_interface.h"
+#include "settings.h"
 
 class ModbusData final : public modbus::DataInterface {
  public:
-  ModbusData(modbus::DataInterface &fw_update) : fw_update_(fw_update) {}
+  enum SweepMode : uint16_t {
+    kSweepOff = 0,
+    kSweepOnce,        // Sweep once in the background.
+    kSweepContinuous,  // Sweep with every background sample.
+  };
 
-  void Start(modbus::FunctionCode fn_code) override {}
+  enum CaptureState : uint16_t {
+    kCaptureIdle = 0,
+    kCaptureRequested,  // Capture in the background.
+    kCaptureFailed,
+  };
+
+  ModbusData(modbus::DataInterface &fw_update);
+
+  void Start(modbus::FunctionCode fn_code, bool broadcast) override {
+    broadcast_ = broadcast;
+    fw_update_.Start(fn_code, broadcast);
+  }
   void Complete() override;
 
   modbus::ExceptionCode ReadRegister(uint16_t address,
                                      uint16_t *data_out) override;
+  modbus::ExceptionCode ReadDiscreteInput(uint16_t address,
+                                          bool *data_out) override;
   modbus::ExceptionCode WriteRegister(uint16_t address, uint16_t data) override;
 
+  // Files are only used by the firmware update.
+  modbus::ExceptionCode ReadFileRecord(uint16_t file, uint16_t record,
+                                       uint16_t *data_out) override {
+    return fw_update_.ReadFileRecord(file, record, data_out);
+  }
+  modbus::ExceptionCode WriteFileRecord(uint16_t file, uint16_t record,
+                                        uint16_t data) override {
+    return fw_update_.WriteFileRecord(file, record, data);
+  }
+
+  // Takes a new measurement for the background sampler.
+  void Sample();
+
+  // Measures at all excitation frequencies of the sweep.
+  void Sweep();
+
+  bool sweep_requested() const { return sweep_mode_ == kSweepOnce; }
+
+  // Records the raw ADC values during settling for diagnostics.
+  void Capture();
+
+  bool capture_requested() const { return capture_state_ == kCaptureRequested; }
+
+  // Background sampling interval in seconds. 0 disables background sampling.
+  uint16_t sample_interval() const { return settings_.sample_interval; }
+
   bool reset() const { return reset_; }
 
  private:
+  // Measures and applies the temperature compensation.
+  void Measure();
+
   modbus::DataInterface &fw_update_;
+  bool broadcast_ = false;
 
   RawMeasurement measurement_;
+  int16_t temperature_;
+  uint16_t compensated_;
   bool measurement_available_ = false;
 
+  RawMeasurement sweep_results_[kMaxSweepPoints] = {};
+  uint16_t sweep_mode_ = kSweepOff;
+
+  uint16_t capture_state_ = kCaptureIdle;
+  uint16_t capture_interval_us_ = 30;  // Covers the settling time of 5ms.
+
+  // Low word of a residency counter, latched when reading the high word.
+  uint16_t residency_low_ = 0;
+
+  Settings settings_;
+
   bool reset_ = false;
 };
 
@@ -2,57 +2,350 @@
 
 #include "modbus_data_fw_update.h"
 
+#include <algorithm>
+#include <iterator>
+
+constexpr uint16_t ModbusDataFwUpdate::kImageFile;
+constexpr uint16_t ModbusDataFwUpdate::kStreamFile;
+constexpr size_t ModbusDataFwUpdate::kBlockSize;
+constexpr size_t ModbusDataFwUpdate::kMaxBlocks;
+
 modbus::ExceptionCode ModbusDataFwUpdate::ReadRegister(uint16_t address,
                                                        uint16_t* data_out) {
-  // All fw update registers are write-only.
-  return modbus::ExceptionCode::kIllegalDataAddress;
+  if (address >= kDigestRegister && address < kDigestRegister + 16) {
+    uint8_t digest[32] = {};
+    bootloader_.ImageDigest(digest);
+    size_t i = 2 * (address - kDigestRegister);
+    *data_out = digest[i] << 8 | digest[i + 1];
+  } else if (address == kHashedLengthRegister) {
+    *data_out = bootloader_.HashedLength();
+  } else if (address == kCrcOffsetRegister) {
+    *data_out = crc_offset_;
+  } else if (address == kCrcLengthRegister) {
+    *data_out = crc_length_;
+  } else if (address == kCrcRegister) {
+    *data_out = crc_ >> 16;
+  } else if (address == kCrcRegister + 1) {
+    *data_out = crc_ & 0xFFFF;
+  } else if (address == kStreamOffsetRegister) {
+    *data_out = stream_words_;
+  } else if (address == kEvictedBlocksRegister) {
+    *data_out = evicted_blocks_;
+  } else if (address == kBlockBitmapRegister) {
+    *data_out = received_blocks_ >> 16;
+  } else if (address == kBlockBitmapRegister + 1) {
+    *data_out = received_blocks_ & 0xFFFF;
+  } else {
+    // Image data registers are write-only.
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  return modbus::ExceptionCode::kOk;
 };
 
+modbus::ExceptionCode ModbusDataFwUpdate::ReadDiscreteInput(uint16_t address,
+                                                            bool* data_out) {
+  return modbus::ExceptionCode::kIllegalDataAddress;
+}
+
 modbus::ExceptionCode ModbusDataFwUpdate::WriteRegister(uint16_t address,
                                                         uint16_t data) {
   if (address == kCommandRegister) {
+    // Commands act on the whole image.
+    if (write_pending()) {
+      return modbus::ExceptionCode::kSlaveDeviceBusy;
+    }
+
     bool ok = false;
 
     switch (data) {
       case Command::kPrepare:
-        ok = bootloader_.PrepareUpdate();
-        write_buffer_.clear();
-        write_offset_ = 0;
+        ok = Prepare();
+        delta_ = false;
+        break;
+
+      case Command::kPrepareDelta:
+        ok = Prepare();
+        delta_ = true;
         break;
 
       case Command::kSetPending:
-        // Write remaining bytes to permanent storage before flagging the
-        // update as pending.
-        if (!write_buffer_.empty()) {
-          write_buffer_.resize(write_buffer_.capacity(), 0xFF);
-          WriteBuffer();
-        }
-        ok = bootloader_.SetUpdatePending();
+        // Only an image that was verified after its last write is booted.
+        ok = verified_ && bootloader_.SetUpdatePending();
         break;
 
       case Command::kConfirm:
         ok = bootloader_.SetUpdateConfirmed();
         break;
+
+      case Command::kVerify:
+        ok = WriteLastBlock() && bootloader_.VerifyUpdate();
+        verified_ = ok;
+        break;
+
+      case Command::kCrc:
+        ok = bootloader_.UpdateSlotCrc32(crc_offset_, crc_length_, &crc_);
+        break;
     }
 
     return ok ? modbus::ExceptionCode::kOk
               : modbus::ExceptionCode::kIllegalDataValue;
   }
 
-  // Assume that the client sends the firmware image data in sequence. If not
-  // the signature check will fail anyway.
-  write_buffer_.push_back(data >> 8);
-  write_buffer_.push_back(data & 0xFF);
-  if (write_buffer_.full()) {
-    WriteBuffer();
+  if (address == kCrcOffsetRegister) {
+    crc_offset_ = data;
+    return modbus::ExceptionCode::kOk;
+  } else if (address == kCrcLengthRegister) {
+    crc_length_ = data;
+    return modbus::ExceptionCode::kOk;
   }
 
+  if (address >= kStreamRegister && address < kDigestRegister) {
+    return WriteStream(address - kStreamRegister, data);
+  }
+
+  return WriteImage(address, data);
+}
+
+modbus::ExceptionCode ModbusDataFwUpdate::ReadFileRecord(uint16_t file,
+                                                         uint16_t record,
+                                                         uint16_t* data_out) {
+  uint8_t data[2];
+  if (file != kImageFile ||
+      !bootloader_.ReadImageData(2 * record, data, sizeof(data))) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  *data_out = data[0] << 8 | data[1];
   return modbus::ExceptionCode::kOk;
 }
 
-void ModbusDataFwUpdate::WriteBuffer() {
-  bootloader_.WriteImageData(write_offset_, write_buffer_.data(),
-                             write_buffer_.size());
-  write_offset_ += write_buffer_.size();
-  write_buffer_.clear();
+modbus::ExceptionCode ModbusDataFwUpdate::WriteFileRecord(uint16_t file,
+                                                          uint16_t record,
+                                                          uint16_t data) {
+  if (file == kImageFile) {
+    return WriteImage(record, data);
+  } else if (file == kStreamFile) {
+    return WriteStream(record, data);
+  }
+
+  return modbus::ExceptionCode::kIllegalDataAddress;
+}
+
+modbus::ExceptionCode ModbusDataFwUpdate::WriteImage(size_t offset,
+                                                     uint16_t data) {
+  size_t block = offset / kWordsPerBlock;
+  size_t word = offset % kWordsPerBlock;
+  if (block >= num_blocks_) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  // Repeated frames do not change the image.
+  if (received_blocks_ & (1u << block)) {
+    return modbus::ExceptionCode::kOk;
+  }
+
+  Buffer* buffer = FindBuffer(block);
+  if (buffer == nullptr) {
+    return modbus::ExceptionCode::kSlaveDeviceBusy;
+  }
+
+  verified_ = false;
+  buffer->data[2 * word] = data >> 8;
+  buffer->data[2 * word + 1] = data & 0xFF;
+  buffer->received_words[word / 32] |= 1u << (word % 32);
+
+  buffer->complete = true;
+  for (uint32_t received : buffer->received_words) {
+    buffer->complete &= (received == UINT32_MAX);
+  }
+
+  return modbus::ExceptionCode::kOk;
+}
+
+bool ModbusDataFwUpdate::WriteLastBlock() {
+  // Write the last block which is only complete up to the end of the image.
+  // The remainder stays in the erased state.
+  // No buffer is complete here, so only one can hold the last block.
+  Buffer* last = nullptr;
+  bool ok = true;
+  for (Buffer& buffer : buffers_) {
+    if (buffer.block != kNoBlock) {
+      ok &= (last == nullptr) && IsLastBlock(buffer);
+      last = &buffer;
+    }
+  }
+  if (ok && last != nullptr) {
+    WriteBuffer(*last);
+  }
+
+  // All blocks up to the last one must have been received.
+  return ok && received_blocks_ != 0 &&
+         (received_blocks_ & (received_blocks_ + 1)) == 0;
+}
+
+bool ModbusDataFwUpdate::Prepare() {
+  for (Buffer& buffer : buffers_) {
+    buffer.block = kNoBlock;
+  }
+  received_blocks_ = 0;
+  evicted_blocks_ = 0;
+  verified_ = false;
+  decoder_.Reset();
+  patch_.Reset();
+  stream_words_ = 0;
+  image_pos_ = 0;
+  return bootloader_.PrepareUpdate();
+}
+
+bool ModbusDataFwUpdate::write_pending() const {
+  for (const Buffer& buffer : buffers_) {
+    if (buffer.block != kNoBlock && buffer.complete) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ModbusDataFwUpdate::WritePending() {
+  for (Buffer& buffer : buffers_) {
+    if (buffer.block != kNoBlock && buffer.complete) {
+      WriteBuffer(buffer);
+      Decompress();
+      return;
+    }
+  }
+}
+
+ModbusDataFwUpdate::Buffer* ModbusDataFwUpdate::FindBuffer(size_t block) {
+  Buffer* unused = nullptr;
+  for (Buffer& buffer : buffers_) {
+    if (buffer.block == block) {
+      return &buffer;
+    }
+    if (buffer.block == kNoBlock && unused == nullptr) {
+      unused = &buffer;
+    }
+  }
+
+  if (unused == nullptr && broadcast_) {
+    for (Buffer& buffer : buffers_) {
+      if (!buffer.complete &&
+          (unused == nullptr || buffer.block < unused->block)) {
+        unused = &buffer;
+      }
+    }
+    if (unused != nullptr) {
+      evicted_blocks_++;
+    }
+  }
+
+  if (unused != nullptr) {
+    unused->block = block;
+    unused->complete = false;
+    std::fill(std::begin(unused->received_words),
+              std::end(unused->received_words), 0);
+    std::fill(std::begin(unused->data), std::end(unused->data), 0xFF);
+  }
+  return unused;
+}
+
+bool ModbusDataFwUpdate::IsLastBlock(const Buffer& buffer) const {
+  if (received_blocks_ >> buffer.block) {
+    return false;
+  }
+
+  // Received words must not have gaps.
+  bool gap = false;
+  for (size_t word = 0; word < kWordsPerBlock; word++) {
+    bool received = buffer.received_words[word / 32] & (1u << (word % 32));
+    if (received && gap) {
+      return false;
+    }
+    gap |= !received;
+  }
+  return true;
+}
+
+void ModbusDataFwUpdate::WriteBuffer(Buffer& buffer) {
+  // A failed block stays missing in the bitmap to be sent again.
+  bool ok = bootloader_.WriteImageData(buffer.block * kBlockSize, buffer.data,
+                                       kBlockSize);
+  if (ok) {
+    received_blocks_ |= 1u << buffer.block;
+  }
+  buffer.block = kNoBlock;
+}
+
+modbus::ExceptionCode ModbusDataFwUpdate::WriteStream(size_t word,
+                                                      uint16_t data) {
+  // Repeated frames do not change the image.
+  if (word < stream_words_) {
+    return modbus::ExceptionCode::kOk;
+  }
+
+  if (word > stream_words_) {
+    return modbus::ExceptionCode::kIllegalDataAddress;
+  }
+
+  // The decompressed image does not fit into the update slot.
+  if (image_pos_ == num_blocks_ * kBlockSize) {
+    return modbus::ExceptionCode::kIllegalDataValue;
+  }
+
+  if (delta_ && patch_.failed()) {
+    return modbus::ExceptionCode::kIllegalDataValue;
+  }
+
+  if (decoder_.space() < 2) {
+    return modbus::ExceptionCode::kSlaveDeviceBusy;
+  }
+
+  verified_ = false;
+  decoder_.Push(data >> 8);
+  decoder_.Push(data & 0xFF);
+  stream_words_++;
+
+  Decompress();
+  return delta_ && patch_.failed() ? modbus::ExceptionCode::kIllegalDataValue
+                                   : modbus::ExceptionCode::kOk;
+}
+
+bool ModbusDataFwUpdate::CanBuffer(size_t block) const {
+  for (const Buffer& buffer : buffers_) {
+    if (buffer.block == block || buffer.block == kNoBlock) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ModbusDataFwUpdate::Decompress() {
+  while (image_pos_ < num_blocks_ * kBlockSize) {
+    size_t block = image_pos_ / kBlockSize;
+    size_t offset = image_pos_ % kBlockSize;
+
+    // Allocate the buffer only when there is data for it.
+    bool received = received_blocks_ & (1u << block);
+    uint8_t byte;
+    if (!received && !CanBuffer(block)) {
+      return;
+    }
+    if (delta_ ? !patch_.Next(decoder_, &byte) : !decoder_.Next(&byte)) {
+      return;
+    }
+    image_pos_++;
+
+    if (received) {
+      continue;
+    }
+
+    Buffer* buffer = FindBuffer(block);
+    buffer->data[offset] = byte;
+    if (offset % 2 == 1) {
+      size_t word = offset / 2;
+      buffer->received_words[word / 32] |= 1u << (word % 32);
+    }
+    buffer->complete = (offset == kBlockSize - 1);
+  }
 }
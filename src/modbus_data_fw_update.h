@@ -3,42 +3,170 @@
 #ifndef FW_UPDATE_
 #define FW_UPDATE_
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 
-#include "etl/vector.h"
-
 #include "bootloader_interface.h"
+#include "delta_patch.h"
+#include "lz_decoder.h"
 #include "modbus/data_interface.h"
 
+// Receives the update image in blocks of 512 bytes. The register address is
+// the word offset in the image so that blocks can be sent in any order and
+// missing blocks can be sent again. Writes to received blocks are ignored.
+//
+// The image can be broadcast to all nodes at once. Each node tracks its
+// received blocks so that missing ones are repaired with unicast writes.
+// Broadcasts that find no free buffer replace an incomplete block, counted in
+// kEvictedBlocksRegister. Masters check it with the block bitmap before
+// kSetPending (see README).
+//
+// The same data is accessible as MODBUS files with the record number as word
+// offset: kImageFile for the image and kStreamFile for the compressed stream.
+// Write file record requests carry more data per frame than register writes.
+//
+// Alternatively the image is sent compressed (see scripts/lz_compress.py) as a
+// stream starting at kStreamRegister and decompressed into the same blocks.
+// After kPrepareDelta the stream is a patch against the running image instead.
 class ModbusDataFwUpdate final : public modbus::DataInterface {
  public:
+  // Compressed image stream. The register address is the word offset in the
+  // stream which must be written without gaps.
+  static constexpr uint16_t kStreamRegister = 0x4000;
+
+  // SHA-256 of the image as 16 big endian registers. All zero until the whole
+  // image was written.
+  static constexpr uint16_t kDigestRegister = 0x7FE0;
+  static constexpr uint16_t kHashedLengthRegister = 0x7FF0;
+
+  // CRC-32 over a byte range of the update slot: offset, length and the
+  // result as (high, low) register pair.
+  static constexpr uint16_t kCrcOffsetRegister = 0x7FF4;
+  static constexpr uint16_t kCrcLengthRegister = 0x7FF5;
+  static constexpr uint16_t kCrcRegister = 0x7FF6;
+
+  // Number of stream words accepted so far.
+  static constexpr uint16_t kStreamOffsetRegister = 0x7FF8;
+
+  // Number of incomplete blocks dropped for a broadcast since the last
+  // prepare command.
+  static constexpr uint16_t kEvictedBlocksRegister = 0x7FF9;
+
+  // 0x7FFC stays unused: The bootloader answers there in recovery mode.
+
+  // Bitmap of the received blocks as (high, low) register pair.
+  static constexpr uint16_t kBlockBitmapRegister = 0x7FFD;
   static constexpr uint16_t kCommandRegister = 0x7FFF;
 
+  static constexpr uint16_t kImageFile = 1;
+  static constexpr uint16_t kStreamFile = 2;
+
+  static constexpr size_t kBlockSize = 512;
+
+  // Limit of the received blocks bitmap. The update slot may hold fewer.
+  static constexpr size_t kMaxBlocks = 32;
+
   enum Command : uint16_t {
     kPrepare = 0,
-    kSetPending,
+    kSetPending,    // Requires kVerify after the last write.
     kConfirm,
+    kVerify,        // Compare the digest with the hash TLV of the image.
+    kCrc,           // Compute the CRC-32 of the configured range.
+    kPrepareDelta,  // Prepare for a patch stream.
   };
 
   explicit ModbusDataFwUpdate(BootloaderInterface& bootloader)
-      : bootloader_(bootloader) {}
+      : bootloader_(bootloader),
+        num_blocks_(
+            std::min(kMaxBlocks, bootloader.MaxImageSize() / kBlockSize)),
+        patch_(bootloader) {}
 
-  void Start(modbus::FunctionCode fn_code) override {}
+  void Start(modbus::FunctionCode fn_code, bool broadcast) override {
+    broadcast_ = broadcast;
+  }
   void Complete() override {}
 
   modbus::ExceptionCode ReadRegister(uint16_t address,
                                      uint16_t* data_out) override;
+  modbus::ExceptionCode ReadDiscreteInput(uint16_t address,
+                                          bool* data_out) override;
   modbus::ExceptionCode WriteRegister(uint16_t address, uint16_t data) override;
 
+  // Reading the image file reads back the update slot.
+  modbus::ExceptionCode ReadFileRecord(uint16_t file, uint16_t record,
+                                       uint16_t* data_out) override;
+  modbus::ExceptionCode WriteFileRecord(uint16_t file, uint16_t record,
+                                        uint16_t data) override;
+
+  // Up to two blocks are received at the same time. A complete block is
+  // written to flash outside of the MODBUS request while the other one fills.
+  // Writes to a third block are answered with a busy exception. The same
+  // applies to stream words while the decompressor waits for a buffer.
+  bool write_pending() const;
+
+  // Writes one complete block. Call again while write_pending() is true.
+  void WritePending();
+
+  uint32_t received_blocks() const { return received_blocks_; }
+
  private:
-  static constexpr size_t kBufferSize = 1024;
+  static constexpr size_t kNumBuffers = 2;
+  static constexpr size_t kNoBlock = SIZE_MAX;
+  static constexpr size_t kWordsPerBlock = kBlockSize / 2;
+
+  struct Buffer {
+    size_t block = kNoBlock;
+    bool complete = false;
+    uint32_t received_words[kWordsPerBlock / 32];
+    alignas(4) uint8_t data[kBlockSize];  // Programmed directly by the IAP.
+  };
+
+  // Buffer for the block or nullptr when all buffers are in use. Broadcasts
+  // cannot be repeated on a busy exception so they replace the lowest
+  // incomplete block instead, which is repaired later.
+  Buffer* FindBuffer(size_t block);
+
+  // The incomplete block at the end of the image.
+  bool IsLastBlock(const Buffer& buffer) const;
+
+  // Writes the block to flash and releases the buffer.
+  void WriteBuffer(Buffer& buffer);
 
-  void WriteBuffer();
+  // Writes a word of the image at the word offset.
+  modbus::ExceptionCode WriteImage(size_t offset, uint16_t data);
+  modbus::ExceptionCode WriteStream(size_t word, uint16_t data);
+
+  // A buffer for the block is available without waiting for a flash write.
+  bool CanBuffer(size_t block) const;
+
+  // Decompresses the stream until it runs out of data or buffers.
+  void Decompress();
+
+  // Writes the incomplete last block and checks that no block is missing.
+  bool WriteLastBlock();
+
+  // Clears the received image before an update.
+  bool Prepare();
 
   BootloaderInterface& bootloader_;
+  const size_t num_blocks_;  // Blocks of the largest image.
+  bool broadcast_ = false;
+
+  Buffer buffers_[kNumBuffers];
+  uint32_t received_blocks_ = 0;
+  uint16_t evicted_blocks_ = 0;
+  bool verified_ = false;  // No image data was written since kVerify.
+
+  LzDecoder decoder_;
+  DeltaPatch patch_;
+  bool delta_ = false;
+  size_t stream_words_ = 0;
+  size_t image_pos_ = 0;  // Decompressed bytes.
 
-  etl::vector<uint8_t, kBufferSize> write_buffer_;
-  size_t write_offset_ = 0;
+  uint16_t crc_offset_ = 0;
+  uint16_t crc_length_ = 0;
+  uint32_t crc_ = 0;
 };
 
 #endif  // FW_UPDATE_
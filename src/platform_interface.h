@@ -0,0 +1,36 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef PLATFORM_INTERFACE_H_
+#define PLATFORM_INTERFACE_H_
+
+#include <cstdint>
+
+// Low power modes ordered from the lightest to the deepest.
+enum class SleepMode {
+  kSleep,      // CPU clock stopped, peripherals running.
+  kDeepSleep,  // All clocks stopped except the low power oscillator.
+};
+
+// Timebase and power management provided by the target platform code for the
+// scheduler.
+class PlatformInterface {
+ public:
+  // Milliseconds since startup. Wraps around after 49 days.
+  virtual uint32_t Now() = 0;
+
+  // Deepest sleep mode the peripherals currently allow.
+  virtual SleepMode DeepestSleepMode() = 0;
+
+  // Time from the wakeup event until the code runs again.
+  virtual uint32_t WakeupLatencyMs(SleepMode mode) = 0;
+
+  // Sleeps until an interrupt is pending or the timeout elapsed.
+  // Called with interrupts disabled. Must return immediately when an interrupt
+  // is already pending.
+  virtual void Sleep(SleepMode mode, uint32_t timeout_ms) = 0;
+
+  virtual void DisableInterrupts() = 0;
+  virtual void EnableInterrupts() = 0;
+};
+
+#endif  // PLATFORM_INTERFACE_H_
@@ -0,0 +1,38 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "residency.h"
+
+#include <cassert>
+
+Residency::State Residency::Enter(State state) {
+  assert(state != kTransmit && state < kNumStates);
+
+  uint32_t now = platform_.Now();
+  totals_[state_] += now - state_since_;
+  state_since_ = now;
+
+  State previous = state_;
+  state_ = state;
+  return previous;
+}
+
+uint32_t Residency::Total(State state) {
+  assert(state < kNumStates);
+
+  uint32_t total = totals_[state];
+  if (state == state_) {
+    total += platform_.Now() - state_since_;
+  } else if (state == kTransmit && transmitting_) {
+    total += platform_.Now() - transmit_since_;
+  }
+  return total;
+}
+
+void Residency::Reset() {
+  uint32_t now = platform_.Now();
+  for (uint32_t &total : totals_) {
+    total = 0;
+  }
+  state_since_ = now;
+  transmit_since_ = now;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef RESIDENCY_H_
+#define RESIDENCY_H_
+
+#include <cstdint>
+
+#include "platform_interface.h"
+
+// Time spent in each power state, to estimate the energy consumption in the
+// field.
+//
+// The CPU is in exactly one of the states active, measure, sleep or deep
+// sleep. Transmitting is counted separately because the UART sends in the
+// background while the CPU is in any of the other states.
+//
+// The time comes from the scheduler timebase which is cheap to read and keeps
+// running in deep sleep. State changes are rounded to milliseconds but the
+// CPU states always add up to the total time.
+class Residency {
+ public:
+  enum State : uint8_t {
+    kActive,
+    kMeasure,
+    kSleep,
+    kDeepSleep,
+    kTransmit,
+    kNumStates,
+  };
+
+  explicit Residency(PlatformInterface &platform) : platform_(platform) {}
+
+  // Switches the CPU state and returns the previous one.
+  State Enter(State state);
+
+  // StopTransmit() is called from the UART interrupt. All other methods must
+  // run with interrupts disabled.
+  // Both are defined here so that the UART driver links without this module
+  // in the bootloader, which never sets a residency.
+  void StartTransmit() {
+    if (!transmitting_) {
+      transmit_since_ = platform_.Now();
+      transmitting_ = true;
+    }
+  }
+
+  void StopTransmit() {
+    if (transmitting_) {
+      totals_[kTransmit] += platform_.Now() - transmit_since_;
+      transmitting_ = false;
+    }
+  }
+
+  // Milliseconds in the state since the last reset including the current
+  // period. Wraps around after 49 days.
+  uint32_t Total(State state);
+
+  void Reset();
+
+ private:
+  PlatformInterface &platform_;
+
+  State state_ = kActive;
+  uint32_t state_since_ = 0;
+
+  bool transmitting_ = false;
+  uint32_t transmit_since_ = 0;
+
+  uint32_t totals_[kNumStates] = {};
+};
+
+#endif  // RESIDENCY_H_
@@ -0,0 +1,107 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "scheduler.h"
+
+#include <cassert>
+
+constexpr size_t Scheduler::kMaxTasks;
+constexpr uint32_t Scheduler::kNoTimeout;
+
+Scheduler::Scheduler(PlatformInterface &platform, const Task *tasks,
+                     size_t num_tasks)
+    : platform_(platform), tasks_(tasks), num_tasks_(num_tasks) {
+  assert(num_tasks <= kMaxTasks);
+}
+
+void Scheduler::PostAfter(size_t task, uint32_t delay_ms) {
+  assert(task < num_tasks_);
+  deadline_[task] = platform_.Now() + delay_ms;
+  deadline_active_[task] = true;
+}
+
+void Scheduler::Cancel(size_t task) {
+  assert(task < num_tasks_);
+  deadline_active_[task] = false;
+}
+
+void Scheduler::RunOnce() {
+  // Deadlines are compared with wrap-around safe arithmetic.
+  uint32_t now = platform_.Now();
+  for (size_t i = 0; i < num_tasks_; i++) {
+    if (deadline_active_[i] && static_cast<int32_t>(now - deadline_[i]) >= 0) {
+      deadline_active_[i] = false;
+      ready_[i] = true;
+    }
+  }
+
+  for (size_t i = 0; i < num_tasks_; i++) {
+    if (ready_[i]) {
+      // Clear before running so that posts during the run are not lost.
+      ready_[i] = false;
+      tasks_[i].run(*this, tasks_[i].context);
+    }
+  }
+
+  // Interrupts stay disabled until after the sleep to not miss a post between
+  // the check and the sleep. A pending interrupt still ends the sleep.
+  platform_.DisableInterrupts();
+  if (!AnyReady()) {
+    uint32_t timeout = NextTimeout(platform_.Now());
+    if (timeout > 0) {
+      SleepMode mode = SelectSleepMode(timeout);
+
+      // Wake up early enough to meet the deadline.
+      uint32_t latency = platform_.WakeupLatencyMs(mode);
+      if (timeout != kNoTimeout) {
+        timeout = (timeout > latency) ? timeout - latency : 0;
+      }
+
+      if (residency_ != nullptr) {
+        residency_->Enter((mode == SleepMode::kDeepSleep)
+                              ? Residency::kDeepSleep
+                              : Residency::kSleep);
+      }
+
+      platform_.Sleep(mode, timeout);
+
+      if (residency_ != nullptr) {
+        residency_->Enter(Residency::kActive);
+      }
+    }
+  }
+  platform_.EnableInterrupts();
+}
+
+bool Scheduler::AnyReady() const {
+  for (size_t i = 0; i < num_tasks_; i++) {
+    if (ready_[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t Scheduler::NextTimeout(uint32_t now) const {
+  uint32_t timeout = kNoTimeout;
+  for (size_t i = 0; i < num_tasks_; i++) {
+    if (deadline_active_[i]) {
+      int32_t remaining = static_cast<int32_t>(deadline_[i] - now);
+      if (remaining <= 0) {
+        return 0;
+      }
+      if (static_cast<uint32_t>(remaining) < timeout) {
+        timeout = remaining;
+      }
+    }
+  }
+  return timeout;
+}
+
+SleepMode Scheduler::SelectSleepMode(uint32_t timeout_ms) {
+  SleepMode mode = platform_.DeepestSleepMode();
+  while (mode != SleepMode::kSleep &&
+         platform_.WakeupLatencyMs(mode) >= timeout_ms) {
+    mode = static_cast<SleepMode>(static_cast<int>(mode) - 1);
+  }
+  return mode;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "platform_interface.h"
+#include "residency.h"
+
+// Tickless run-to-completion scheduler.
+//
+// Tasks are defined in a static table and identified by their index. A task
+// runs once after it was posted, either directly (also from interrupts) or
+// when its deadline passed. Multiple posts before the task runs are merged.
+// Without ready tasks the scheduler sleeps in the deepest mode that still
+// wakes up in time for the next deadline.
+class Scheduler {
+ public:
+  static constexpr size_t kMaxTasks = 8;
+  static constexpr uint32_t kNoTimeout = UINT32_MAX;
+
+  struct Task {
+    void (*run)(Scheduler &scheduler, void *context);
+    void *context;
+  };
+
+  Scheduler(PlatformInterface &platform, const Task *tasks, size_t num_tasks);
+
+  // Marks the task as ready. Interrupt safe.
+  // Defined here so that the UART driver links without this module in the
+  // bootloader.
+  void Post(size_t task) {
+    assert(task < num_tasks_);
+    ready_[task] = true;
+  }
+
+  // Posts the task after the delay. Replaces a previous deadline of the task.
+  void PostAfter(size_t task, uint32_t delay_ms);
+
+  // Removes the deadline of the task.
+  void Cancel(size_t task);
+
+  // Accounts the time spent sleeping.
+  void set_residency(Residency *residency) { residency_ = residency; }
+
+  // Runs all ready tasks in table order, then sleeps until the next interrupt
+  // or deadline.
+  void RunOnce();
+
+ private:
+  bool AnyReady() const;
+
+  // Time until the next deadline or kNoTimeout.
+  uint32_t NextTimeout(uint32_t now) const;
+
+  SleepMode SelectSleepMode(uint32_t timeout_ms);
+
+  PlatformInterface &platform_;
+  const Task *const tasks_;
+  const size_t num_tasks_;
+
+  Residency *residency_ = nullptr;
+
+  // Written by interrupts. Single byte stores do not need a critical section.
+  volatile bool ready_[kMaxTasks] = {};
+
+  bool deadline_active_[kMaxTasks] = {};
+  uint32_t deadline_[kMaxTasks] = {};
+};
+
+#endif  // SCHEDULER_H_
@@ -0,0 +1,46 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "calibration.h"
+#include "temperature_compensation.h"
+
+constexpr size_t kMaxSweepPoints = 8;
+
+// User configuration that is kept in flash across resets.
+// Plain data without padding so that it can be stored and checksummed as is.
+// New fields must be appended: Settings stored by an older firmware are
+// loaded as prefix and the new fields keep their defaults.
+struct Settings {
+  uint16_t alarm_threshold_low;
+  uint16_t alarm_threshold_high;
+  uint16_t sample_interval;
+  Calibration calibration;
+  TemperatureCompensation compensation;
+
+  // SCT reload values of the excitation frequency sweep.
+  uint16_t sweep_num_points;
+  uint16_t sweep_reloads[kMaxSweepPoints];
+
+  // Non-zero to enter deep sleep when the bus is idle. Off by default, see
+  // register 0x14.
+  uint16_t deep_sleep;
+};
+
+// Used when the flash does not contain valid settings.
+constexpr Settings kDefaultSettings = {
+    0,      // alarm_threshold_low
+    0xFFF,  // alarm_threshold_high
+    0,      // sample_interval
+    {},     // calibration
+    {},     // compensation
+    4,      // sweep_num_points
+    {0, 1, 3, 7},  // sweep_reloads: 15MHz, 7.5MHz, 3.75MHz, 1.875MHz
+    0,             // deep_sleep
+};
+
+#endif  // SETTINGS_H_
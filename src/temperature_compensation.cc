@@ -0,0 +1,42 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "temperature_compensation.h"
+
+#include <algorithm>
+
+constexpr int16_t TemperatureCompensation::kInvalidTemperature;
+
+namespace {
+
+// Converts a fixed point value to an integer, rounded to nearest.
+// Signed right shifts are implementation defined before C++20.
+int32_t FixedToInt(int32_t value, int fraction_bits) {
+  value += 1 << (fraction_bits - 1);
+  return value >= 0 ? value >> fraction_bits
+                    : -((-value - 1) >> fraction_bits) - 1;
+}
+
+}  // namespace
+
+int16_t TemperatureCompensation::Temperature(uint16_t diodes) const {
+  if (!IsEnabled()) {
+    return kInvalidTemperature;
+  }
+
+  // 16bit x 16bit: The product fits into 32bit.
+  int32_t delta = FixedToInt((diodes - diode_ref) * temperature_slope, 8);
+  int32_t temperature = temperature_ref + delta;
+  return std::min<int32_t>(std::max<int32_t>(temperature, INT16_MIN + 1),
+                           INT16_MAX);
+}
+
+uint16_t TemperatureCompensation::Apply(uint16_t raw,
+                                        int16_t temperature) const {
+  if (!IsEnabled()) {
+    return raw;
+  }
+
+  int32_t delta_t = temperature - temperature_ref;
+  int32_t corrected = raw - FixedToInt(delta_t * raw_slope, 16);
+  return std::min<int32_t>(std::max<int32_t>(corrected, 0), UINT16_MAX);
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef TEMPERATURE_COMPENSATION_H_
+#define TEMPERATURE_COMPENSATION_H_
+
+#include <cstdint>
+
+// Estimates the temperature from the diode voltage and corrects the raw
+// capacitive reading with linear coefficients.
+// Cheap enough to run on every sample: Integer multiplications and shifts only.
+// Plain data so that it can be stored in flash as part of the settings.
+struct TemperatureCompensation {
+  // Returned by Temperature() when the compensation is not configured.
+  static constexpr int16_t kInvalidTemperature = INT16_MIN;
+
+  bool IsEnabled() const { return temperature_slope != 0; }
+
+  // Returns the temperature in 0.01°C for a diode ADC value.
+  int16_t Temperature(uint16_t diodes) const;
+
+  // Returns the raw value corrected to the reference temperature.
+  uint16_t Apply(uint16_t raw, int16_t temperature) const;
+
+  // Diode ADC value at the reference temperature.
+  uint16_t diode_ref;
+
+  // Reference temperature in 0.01°C.
+  int16_t temperature_ref;
+
+  // Temperature change per diode ADC count in 0.01°C, Q8 fixed point.
+  // 0 disables the compensation.
+  int16_t temperature_slope;
+
+  // Raw value change per 0.01°C, Q16 fixed point.
+  int16_t raw_slope;
+};
+
+#endif  // TEMPERATURE_COMPENSATION_H_
@@ -0,0 +1,24 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#include "threshold_alarms.h"
+
+constexpr uint16_t ThresholdAlarms::kNormalPwmReload;
+
+void ThresholdAlarms::Latch(Range range) {
+  if (!armed_) {
+    return;
+  }
+
+  switch (range) {
+    case Range::kBelow:
+      flags_ |= kAlarmBelowLow;
+      break;
+
+    case Range::kAbove:
+      flags_ |= kAlarmAboveHigh;
+      break;
+
+    default:
+      break;
+  }
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2019 Timo Kröger <timokroeger93+code@gmail.com>
+
+#ifndef THRESHOLD_ALARMS_H_
+#define THRESHOLD_ALARMS_H_
+
+#include <cstdint>
+
+// Latched threshold alarms of the moisture channel (RawMeasurement::high).
+enum AlarmFlags : uint16_t {
+  kAlarmBelowLow = (1 << 0),
+  kAlarmAboveHigh = (1 << 1),
+};
+
+// Latches the results of the ADC hardware threshold comparison. The thresholds
+// apply to the normal measurement only: Sweep points at other excitation
+// frequencies and the settling recorded by a capture convert different values
+// and must not change the alarm state.
+class ThresholdAlarms {
+ public:
+  // Excitation of the normal measurement: 15MHz.
+  static constexpr uint16_t kNormalPwmReload = 0;
+
+  // Comparison result of one conversion.
+  enum class Range : uint8_t {
+    kInside,
+    kBelow,
+    kAbove,
+  };
+
+  // Called from the threshold interrupt. Ignored while not armed.
+  void Latch(Range range);
+
+  // Arms the alarms for the conversions that follow when they use the
+  // excitation of the normal measurement.
+  void SelectPwmReload(uint16_t pwm_reload) {
+    armed_ = pwm_reload == kNormalPwmReload;
+  }
+
+  // Disarms the alarms for all conversions until Resume().
+  void Suspend() { armed_ = false; }
+  void Resume() { armed_ = true; }
+
+  bool armed() const { return armed_; }
+  uint16_t flags() const { return flags_; }
+  void Clear() { flags_ = 0; }
+
+ private:
+  volatile uint16_t flags_ = 0;
+  volatile bool armed_ = true;
+};
+
+#endif  // THRESHOLD_ALARMS_H_
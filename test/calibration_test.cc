@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+
+#include "calibration.h"
+
+namespace {
+
+TEST(CalibrationTest, Invalid) {
+  Calibration cal = {};
+  EXPECT_FALSE(cal.IsValid());
+  EXPECT_EQ(cal.Apply(1000), Calibration::kInvalid);
+
+  cal.num_points = 1;
+  cal.points[0] = {100, 0};
+  EXPECT_FALSE(cal.IsValid());
+
+  // Raw values must be strictly ascending.
+  cal.num_points = 3;
+  cal.points[1] = {200, 1000};
+  cal.points[2] = {200, 2000};
+  EXPECT_FALSE(cal.IsValid());
+  EXPECT_EQ(cal.Apply(150), Calibration::kInvalid);
+
+  cal.points[2] = {300, Calibration::kMaxVwc + 1};
+  EXPECT_FALSE(cal.IsValid());
+
+  cal.num_points = Calibration::kMaxPoints + 1;
+  EXPECT_FALSE(cal.IsValid());
+}
+
+TEST(CalibrationTest, Interpolation) {
+  Calibration cal = {3, {{1000, 0}, {2000, 3000}, {3000, 4000}}};
+  ASSERT_TRUE(cal.IsValid());
+
+  EXPECT_EQ(cal.Apply(1000), 0);
+  EXPECT_EQ(cal.Apply(1500), 1500);
+  EXPECT_EQ(cal.Apply(1999), 2997);
+  EXPECT_EQ(cal.Apply(2000), 3000);
+  EXPECT_EQ(cal.Apply(2250), 3250);
+  EXPECT_EQ(cal.Apply(3000), 4000);
+}
+
+TEST(CalibrationTest, Clamping) {
+  Calibration cal = {2, {{1000, 500}, {2000, 4500}}};
+  EXPECT_EQ(cal.Apply(0), 500);
+  EXPECT_EQ(cal.Apply(999), 500);
+  EXPECT_EQ(cal.Apply(2001), 4500);
+  EXPECT_EQ(cal.Apply(0xFFFF), 4500);
+}
+
+TEST(CalibrationTest, FallingCurve) {
+  Calibration cal = {2, {{0, 10000}, {0xFFFF, 0}}};
+  EXPECT_EQ(cal.Apply(0), 10000);
+  EXPECT_EQ(cal.Apply(0x8000), 5000);
+  EXPECT_EQ(cal.Apply(0xFFFF), 0);
+}
+
+}  // namespace
@@ -0,0 +1,121 @@
+#include "gtest/gtest.h"
+
+#include <numeric>
+#include <vector>
+
+#include "delta_patch.h"
+#include "fake_bootloader.h"
+#include "lz_decoder.h"
+
+namespace {
+
+class DeltaPatchTest : public ::testing::Test {
+ protected:
+  DeltaPatchTest() : patch(bl) {
+    bl.running_image.resize(100);
+    std::iota(bl.running_image.begin(), bl.running_image.end(), 0);
+    std::iota(bl.running_digest.begin(), bl.running_digest.end(), 0x40);
+  }
+
+  // Patch header for the running image.
+  std::vector<uint8_t> Header() {
+    std::vector<uint8_t> header = {'S', 'S', 'U', 'P'};
+    header.insert(header.end(), bl.running_digest.begin(),
+                  bl.running_digest.end());
+    return header;
+  }
+
+  // Passes the patch through the decoder as uncompressed literals.
+  void Push(const std::vector<uint8_t>& data) {
+    for (size_t i = 0; i < data.size(); i++) {
+      if (i % 8 == 0) {
+        ASSERT_TRUE(input.Push(0xFF));
+      }
+      ASSERT_TRUE(input.Push(data[i]));
+    }
+  }
+
+  std::vector<uint8_t> Apply() {
+    std::vector<uint8_t> out;
+    uint8_t byte;
+    while (patch.Next(input, &byte)) {
+      out.push_back(byte);
+    }
+    return out;
+  }
+
+  FakeBootloader bl;
+  LzDecoder input;
+  DeltaPatch patch;
+};
+
+TEST_F(DeltaPatchTest, copy_and_insert) {
+  std::vector<uint8_t> data = Header();
+  data.insert(data.end(), {
+                              DeltaPatch::kCopy, 10, 0, 5, 0,
+                              DeltaPatch::kInsert, 3, 0, 0xAA, 0xBB, 0xCC,
+                              DeltaPatch::kCopy, 0, 0, 2, 0,
+                          });
+  Push(data);
+
+  EXPECT_EQ(Apply(), std::vector<uint8_t>(
+                         {10, 11, 12, 13, 14, 0xAA, 0xBB, 0xCC, 0, 1}));
+  EXPECT_FALSE(patch.failed());
+}
+
+TEST_F(DeltaPatchTest, copies_in_chunks) {
+  std::vector<uint8_t> data = Header();
+  data.insert(data.end(), {DeltaPatch::kCopy, 0, 0, 100, 0});
+  Push(data);
+
+  std::vector<uint8_t> expected(100);
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_EQ(Apply(), expected);
+  EXPECT_FALSE(patch.failed());
+  EXPECT_EQ(bl.running_image_reads, 4u);
+}
+
+TEST_F(DeltaPatchTest, waits_for_input) {
+  std::vector<uint8_t> data = Header();
+  data.insert(data.end(), {DeltaPatch::kInsert, 2, 0, 0x11});
+  Push(std::vector<uint8_t>(data.begin(), data.begin() + 8));
+  EXPECT_TRUE(Apply().empty());
+  EXPECT_FALSE(patch.failed());
+
+  input.Reset();
+  Push(data);
+  patch.Reset();
+  EXPECT_EQ(Apply(), std::vector<uint8_t>({0x11}));
+  EXPECT_FALSE(patch.failed());
+}
+
+TEST_F(DeltaPatchTest, rejects_other_base_image) {
+  std::vector<uint8_t> data = Header();
+  data.insert(data.end(), {DeltaPatch::kInsert, 1, 0, 0x11});
+  bl.running_digest[31]++;
+  Push(data);
+
+  EXPECT_TRUE(Apply().empty());
+  EXPECT_TRUE(patch.failed());
+}
+
+TEST_F(DeltaPatchTest, rejects_copy_outside_image) {
+  std::vector<uint8_t> data = Header();
+  data.insert(data.end(), {DeltaPatch::kCopy, 98, 0, 3, 0});
+  Push(data);
+
+  // The chunk holding the copy is read at once.
+  EXPECT_TRUE(Apply().empty());
+  EXPECT_TRUE(patch.failed());
+}
+
+TEST_F(DeltaPatchTest, rejects_unknown_operation) {
+  std::vector<uint8_t> data = Header();
+  data.insert(data.end(), {0x7F, 0, 0});
+  Push(data);
+
+  EXPECT_TRUE(Apply().empty());
+  EXPECT_TRUE(patch.failed());
+}
+
+}  // namespace
@@ -0,0 +1,91 @@
+#ifndef FAKE_BOOTLOADER_H_
+#define FAKE_BOOTLOADER_H_
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <vector>
+
+#include "bootloader_interface.h"
+
+class FakeBootloader final : public BootloaderInterface {
+ public:
+  static constexpr size_t kMemorySize = 4 * 1024;
+
+  bool PrepareUpdate() override {
+    prepared = true;
+    return true;
+  }
+
+  bool WriteImageData(size_t offset, uint8_t* data, size_t length) override {
+    if (!prepared) {
+      return false;
+    }
+
+    auto end = std::copy_n(data, length, update_memory.begin() + offset);
+    return end == update_memory.begin() + offset + length;
+  }
+
+  size_t MaxImageSize() override { return kMemorySize; }
+
+  bool ReadImageData(size_t offset, uint8_t* data, size_t length) override {
+    if (offset + length > kMemorySize) {
+      return false;
+    }
+    std::copy_n(update_memory.begin() + offset, length, data);
+    return true;
+  }
+
+  bool SetUpdatePending() override {
+    pending = true;
+    return true;
+  }
+
+  size_t HashedLength() override { return hashed_length; }
+
+  bool ImageDigest(uint8_t* digest) override {
+    if (hashed_length == 0) {
+      return false;
+    }
+    std::iota(digest, digest + 32, 0);
+    return true;
+  }
+
+  bool VerifyUpdate() override { return hashed_length > 0; }
+
+  bool UpdateSlotCrc32(size_t offset, size_t length, uint32_t* crc) override {
+    if (offset + length > kMemorySize) {
+      return false;
+    }
+    // Not a real CRC, only identifies the range.
+    *crc = offset << 16 | length;
+    return true;
+  }
+
+  bool ReadRunningImage(size_t offset, uint8_t* data, size_t length) override {
+    running_image_reads++;
+    if (offset + length > running_image.size()) {
+      return false;
+    }
+    std::copy_n(running_image.begin() + offset, length, data);
+    return true;
+  }
+
+  bool RunningImageDigest(uint8_t* digest) override {
+    std::copy(running_digest.begin(), running_digest.end(), digest);
+    return true;
+  }
+
+  bool SetUpdateConfirmed() override { return true; }
+
+  std::array<uint8_t, kMemorySize> update_memory;
+  bool prepared = false;
+  bool pending = false;
+  size_t hashed_length = 0;
+
+  std::vector<uint8_t> running_image;
+  size_t running_image_reads = 0;
+  std::array<uint8_t, 32> running_digest = {};
+};
+
+#endif  // FAKE_BOOTLOADER_H_
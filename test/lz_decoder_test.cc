@@ -0,0 +1,85 @@
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "lz_decoder.h"
+
+namespace {
+
+std::vector<uint8_t> Decode(LzDecoder& decoder) {
+  std::vector<uint8_t> out;
+  uint8_t byte;
+  while (decoder.Next(&byte)) {
+    out.push_back(byte);
+  }
+  return out;
+}
+
+void PushAll(LzDecoder& decoder, const std::vector<uint8_t>& data) {
+  for (uint8_t byte : data) {
+    ASSERT_TRUE(decoder.Push(byte));
+  }
+}
+
+TEST(LzDecoderTest, literals) {
+  LzDecoder decoder;
+  PushAll(decoder, {0xFF, 1, 2, 3, 4, 5, 6, 7, 8, 0x01, 9});
+  EXPECT_EQ(Decode(decoder), std::vector<uint8_t>({1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+TEST(LzDecoderTest, overlapping_match) {
+  LzDecoder decoder;
+  // Two literals followed by a match of 5 bytes at distance 2.
+  PushAll(decoder, {0b011, 0xAB, 0xCD, 1, 2});
+  EXPECT_EQ(Decode(decoder), std::vector<uint8_t>(
+                                 {0xAB, 0xCD, 0xAB, 0xCD, 0xAB, 0xCD, 0xAB}));
+}
+
+TEST(LzDecoderTest, waits_for_complete_match) {
+  LzDecoder decoder;
+  PushAll(decoder, {0b01, 0x55, 0});
+  EXPECT_EQ(Decode(decoder), std::vector<uint8_t>({0x55}));
+
+  // Longest match.
+  PushAll(decoder, {255});
+  EXPECT_EQ(Decode(decoder), std::vector<uint8_t>(258, 0x55));
+}
+
+TEST(LzDecoderTest, match_across_window_end) {
+  LzDecoder decoder;
+  std::vector<uint8_t> expected;
+  for (size_t i = 0; i < 304; i++) {
+    expected.push_back(i);
+    if (i % 8 == 0) {
+      ASSERT_TRUE(decoder.Push(0xFF));
+    }
+    ASSERT_TRUE(decoder.Push(i));
+    if (i % 8 == 7) {
+      Decode(decoder);
+    }
+  }
+
+  // Copy from the oldest byte in the window.
+  PushAll(decoder, {0x00, 255, 0});
+  EXPECT_EQ(Decode(decoder), std::vector<uint8_t>(expected.end() - 256,
+                                                  expected.end() - 256 + 3));
+}
+
+TEST(LzDecoderTest, input_full) {
+  LzDecoder decoder;
+  for (size_t i = 0; i < LzDecoder::kInputSize; i++) {
+    ASSERT_TRUE(decoder.Push(0xFF));
+  }
+  EXPECT_EQ(decoder.space(), 0u);
+  EXPECT_FALSE(decoder.Push(0xFF));
+
+  uint8_t byte;
+  EXPECT_TRUE(decoder.Next(&byte));
+  EXPECT_EQ(decoder.space(), 2u);  // Flag and literal.
+
+  decoder.Reset();
+  EXPECT_EQ(decoder.space(), LzDecoder::kInputSize);
+  EXPECT_FALSE(decoder.Next(&byte));
+}
+
+}  // namespace
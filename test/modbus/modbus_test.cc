@@ -15,12 +15,20 @@ namespace modbus {
 
 class DataMock : public DataInterface {
  public:
-  MOCK_METHOD1(Start, void(modbus::FunctionCode fn_code));
+  MOCK_METHOD2(Start, void(modbus::FunctionCode fn_code, bool broadcast));
   MOCK_METHOD0(Complete, void());
   MOCK_METHOD2(ReadRegister,
                modbus::ExceptionCode(uint16_t address, uint16_t* data_out));
+  MOCK_METHOD2(ReadDiscreteInput,
+               modbus::ExceptionCode(uint16_t address, bool* data_out));
   MOCK_METHOD2(WriteRegister,
                modbus::ExceptionCode(uint16_t address, uint16_t data));
+  MOCK_METHOD3(ReadFileRecord,
+               modbus::ExceptionCode(uint16_t file, uint16_t record,
+                                     uint16_t* data_out));
+  MOCK_METHOD3(WriteFileRecord,
+               modbus::ExceptionCode(uint16_t file, uint16_t record,
+                                     uint16_t data));
 };
 
 class ModbusTest : public ::testing::Test {
@@ -28,8 +36,14 @@ class ModbusTest : public ::testing::Test {
   ModbusTest() : data_(), modbus_(data_) {
     ON_CALL(data_, ReadRegister(_, _))
         .WillByDefault(Return(modbus::ExceptionCode::kOk));
+    ON_CALL(data_, ReadDiscreteInput(_, _))
+        .WillByDefault(Return(modbus::ExceptionCode::kOk));
     ON_CALL(data_, WriteRegister(_, _))
         .WillByDefault(Return(modbus::ExceptionCode::kOk));
+    ON_CALL(data_, ReadFileRecord(_, _, _))
+        .WillByDefault(Return(modbus::ExceptionCode::kOk));
+    ON_CALL(data_, WriteFileRecord(_, _, _))
+        .WillByDefault(Return(modbus::ExceptionCode::kOk));
   }
 
   void SetUp() override { modbus_.set_address(1); }
@@ -57,6 +71,82 @@ TEST_F(ModbusTest, Empty) {
   ASSERT_FALSE(modbus_.Execute(&req, &resp));
 }
 
+TEST_F(ModbusTest, ReadDiscreteInputs) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x02,        // Function code
+      0x00, 0x10,  // Starting Address
+      0x00, 0x0A,  // Quantity of Inputs
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x02,  // Function code
+      0x02,  // Byte Count
+      0x81,  // Inputs 0x17-0x10
+      0x02,  // Inputs 0x19-0x18
+  };
+
+  EXPECT_CALL(data_, ReadDiscreteInput(_, _))
+      .Times(7)
+      .WillRepeatedly(
+          DoAll(SetArgPointee<1>(false), Return(modbus::ExceptionCode::kOk)));
+  EXPECT_CALL(data_, ReadDiscreteInput(0x10, _))
+      .WillOnce(
+          DoAll(SetArgPointee<1>(true), Return(modbus::ExceptionCode::kOk)));
+  EXPECT_CALL(data_, ReadDiscreteInput(0x17, _))
+      .WillOnce(
+          DoAll(SetArgPointee<1>(true), Return(modbus::ExceptionCode::kOk)));
+  EXPECT_CALL(data_, ReadDiscreteInput(0x19, _))
+      .WillOnce(
+          DoAll(SetArgPointee<1>(true), Return(modbus::ExceptionCode::kOk)));
+  RequestResponse(request, sizeof(request), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, ReadDiscreteInputsInvalidLength) {
+  const uint8_t request1[] = {
+      0x01,        // Slave address
+      0x02,        // Function code
+      0x00, 0x10,  // Starting Address
+      0x00, 0x00,  // Quantity of Inputs
+  };
+
+  const uint8_t request2[] = {
+      0x01,        // Slave address
+      0x02,        // Function code
+      0x00, 0x10,  // Starting Address
+      0x07, 0xD1,  // Quantity of Inputs
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x82,  // Error code
+      0x03,  // Exception code
+  };
+
+  RequestResponse(request1, sizeof(request1), response, sizeof(response));
+  RequestResponse(request2, sizeof(request2), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, ReadDiscreteInputsInvalidAddress) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x02,        // Function code
+      0x00, 0x10,  // Starting Address
+      0x00, 0x01,  // Quantity of Inputs
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x82,  // Error code
+      0x02,  // Exception code
+  };
+
+  EXPECT_CALL(data_, ReadDiscreteInput(0x10, _))
+      .WillOnce(Return(modbus::ExceptionCode::kIllegalDataAddress));
+  RequestResponse(request, sizeof(request), response, sizeof(response));
+}
+
 TEST_F(ModbusTest, ReadInputRegister) {
   const uint8_t request[] = {
       0x01,        // Slave address
@@ -234,6 +324,25 @@ TEST_F(ModbusTest, WriteSingleRegisterInvalidAddress) {
   RequestResponse(request, sizeof(request), response, sizeof(response));
 }
 
+TEST_F(ModbusTest, WriteSingleRegisterBusy) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x06,        // Function code
+      0x45, 0x67,  // Starting Address
+      0xAB, 0xCD,  // Register Value
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x86,  // Error code
+      0x06,  // Exception code
+  };
+
+  EXPECT_CALL(data_, WriteRegister(0x4567, 0xABCD))
+      .WillOnce(Return(modbus::ExceptionCode::kSlaveDeviceBusy));
+  RequestResponse(request, sizeof(request), response, sizeof(response));
+}
+
 TEST_F(ModbusTest, WriteSingleRegisterMalformed) {
   const uint8_t request1[] = {
       0x01,        // Slave address
@@ -391,6 +500,279 @@ TEST_F(ModbusTest, WriteMultipleRegistersMalformed) {
   RequestNoResponse(request2, sizeof(request2));
 }
 
+TEST_F(ModbusTest, ReadFileRecord) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x14,        // Function code
+      0x0E,        // Byte Count
+      0x06,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x00, 0x01,  // Record Number
+      0x00, 0x02,  // Record Length
+      0x06,        // Reference Type
+      0x00, 0x03,  // File Number
+      0x00, 0x09,  // Record Number
+      0x00, 0x01,  // Record Length
+  };
+
+  const uint8_t response[] = {
+      0x01,        // Slave address
+      0x14,        // Function code
+      0x0A,        // Response Data Length
+      0x05,        // File Response Length
+      0x06,        // Reference Type
+      0x0D, 0xFE,  // Record Data
+      0x00, 0x20,  // Record Data
+      0x03,        // File Response Length
+      0x06,        // Reference Type
+      0x33, 0xCD,  // Record Data
+  };
+
+  InSequence s;
+  EXPECT_CALL(data_, ReadFileRecord(4, 1, _))
+      .WillOnce(
+          DoAll(SetArgPointee<2>(0x0DFE), Return(modbus::ExceptionCode::kOk)));
+  EXPECT_CALL(data_, ReadFileRecord(4, 2, _))
+      .WillOnce(
+          DoAll(SetArgPointee<2>(0x0020), Return(modbus::ExceptionCode::kOk)));
+  EXPECT_CALL(data_, ReadFileRecord(3, 9, _))
+      .WillOnce(
+          DoAll(SetArgPointee<2>(0x33CD), Return(modbus::ExceptionCode::kOk)));
+  RequestResponse(request, sizeof(request), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, ReadFileRecordInvalidLength) {
+  const uint8_t request1[] = {
+      0x01,        // Slave address
+      0x14,        // Function code
+      0x08,        // Byte Count
+      0x06,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x00, 0x01,  // Record Number
+      0x00, 0x02,  // Record Length
+      0x00,
+  };
+
+  // Response would exceed the maximum frame size.
+  const uint8_t request2[] = {
+      0x01,        // Slave address
+      0x14,        // Function code
+      0x07,        // Byte Count
+      0x06,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x00, 0x01,  // Record Number
+      0x00, 0x7B,  // Record Length
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x94,  // Error code
+      0x03,  // Exception code
+  };
+
+  EXPECT_CALL(data_, ReadFileRecord(_, _, _)).Times(0);
+  RequestResponse(request1, sizeof(request1), response, sizeof(response));
+  RequestResponse(request2, sizeof(request2), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, ReadFileRecordInvalidAddress) {
+  const uint8_t request1[] = {
+      0x01,        // Slave address
+      0x14,        // Function code
+      0x07,        // Byte Count
+      0x05,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x00, 0x01,  // Record Number
+      0x00, 0x02,  // Record Length
+  };
+
+  const uint8_t request2[] = {
+      0x01,        // Slave address
+      0x14,        // Function code
+      0x07,        // Byte Count
+      0x06,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x27, 0x0F,  // Record Number
+      0x00, 0x02,  // Record Length
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x94,  // Error code
+      0x02,  // Exception code
+  };
+
+  EXPECT_CALL(data_, ReadFileRecord(_, _, _)).Times(0);
+  RequestResponse(request1, sizeof(request1), response, sizeof(response));
+  RequestResponse(request2, sizeof(request2), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, ReadFileRecordMalformed) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x14,        // Function code
+      0x07,        // Byte Count
+      0x06,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x00, 0x01,  // Record Number
+      0x00,        // Record Length
+  };
+
+  RequestNoResponse(request, sizeof(request));
+}
+
+TEST_F(ModbusTest, WriteFileRecord) {
+  const uint8_t request_response[] = {
+      0x01,        // Slave address
+      0x15,        // Function code
+      0x0D,        // Request Data Length
+      0x06,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x00, 0x07,  // Record Number
+      0x00, 0x03,  // Record Length
+      0x06, 0xAF,  // Record Data
+      0x04, 0xBE,  // Record Data
+      0x10, 0x0D,  // Record Data
+  };
+
+  InSequence s;
+  EXPECT_CALL(data_, WriteFileRecord(4, 7, 0x06AF))
+      .WillOnce(Return(modbus::ExceptionCode::kOk));
+  EXPECT_CALL(data_, WriteFileRecord(4, 8, 0x04BE))
+      .WillOnce(Return(modbus::ExceptionCode::kOk));
+  EXPECT_CALL(data_, WriteFileRecord(4, 9, 0x100D))
+      .WillOnce(Return(modbus::ExceptionCode::kOk));
+  RequestResponse(request_response, sizeof(request_response), request_response,
+                  sizeof(request_response));
+}
+
+TEST_F(ModbusTest, WriteFileRecordInvalidLength) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x15,        // Function code
+      0x0B,        // Request Data Length
+      0x06,        // Reference Type
+      0x00, 0x04,  // File Number
+      0x00, 0x07,  // Record Number
+      0x00, 0x03,  // Record Length
+      0x06, 0xAF,  // Record Data
+      0x04, 0xBE,  // Record Data
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x95,  // Error code
+      0x03,  // Exception code
+  };
+
+  EXPECT_CALL(data_, WriteFileRecord(_, _, _)).Times(0);
+  RequestResponse(request, sizeof(request), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, WriteFileRecordInvalidAddress) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x15,        // Function code
+      0x09,        // Request Data Length
+      0x06,        // Reference Type
+      0x00, 0x00,  // File Number
+      0x00, 0x07,  // Record Number
+      0x00, 0x01,  // Record Length
+      0x06, 0xAF,  // Record Data
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x95,  // Error code
+      0x02,  // Exception code
+  };
+
+  EXPECT_CALL(data_, WriteFileRecord(_, _, _)).Times(0);
+  RequestResponse(request, sizeof(request), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, WriteFileRecordBusy) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x15,        // Function code
+      0x09,        // Request Data Length
+      0x06,        // Reference Type
+      0x00, 0x01,  // File Number
+      0x00, 0x07,  // Record Number
+      0x00, 0x01,  // Record Length
+      0x06, 0xAF,  // Record Data
+  };
+
+  const uint8_t response[] = {
+      0x01,  // Slave address
+      0x95,  // Error code
+      0x06,  // Exception code
+  };
+
+  EXPECT_CALL(data_, WriteFileRecord(1, 7, 0x06AF))
+      .WillOnce(Return(modbus::ExceptionCode::kSlaveDeviceBusy));
+  RequestResponse(request, sizeof(request), response, sizeof(response));
+}
+
+TEST_F(ModbusTest, WriteFileRecordMalformed) {
+  const uint8_t request[] = {
+      0x01,        // Slave address
+      0x15,        // Function code
+      0x09,        // Request Data Length
+      0x06,        // Reference Type
+      0x00, 0x01,  // File Number
+      0x00, 0x07,  // Record Number
+      0x00, 0x01,  // Record Length
+      0x06,        // Record Data
+  };
+
+  RequestNoResponse(request, sizeof(request));
+}
+
+TEST_F(ModbusTest, WriteSingleRegisterBroadcast) {
+  const uint8_t request[] = {
+      0x00,        // Broadcast address
+      0x06,        // Function code
+      0x45, 0x67,  // Starting Address
+      0xAB, 0xCD,  // Register Value
+  };
+
+  EXPECT_CALL(data_, Start(FunctionCode::kWriteSingleRegister, true));
+  EXPECT_CALL(data_, WriteRegister(0x4567, 0xABCD))
+      .WillOnce(Return(modbus::ExceptionCode::kOk));
+  RequestNoResponse(request, sizeof(request));
+}
+
+TEST_F(ModbusTest, WriteMultipleRegistersBroadcastException) {
+  const uint8_t request[] = {
+      0x00,        // Broadcast address
+      0x10,        // Function code
+      0x45, 0x67,  // Starting Address
+      0x00, 0x02,  // Quantity of Registers
+      0x04,        // Byte Count
+      0xAB, 0xCD,  // Register Value 1
+      0xBE, 0xAF,  // Register Value 2
+  };
+
+  // Exceptions are not reported either.
+  EXPECT_CALL(data_, WriteRegister(0x4567, 0xABCD))
+      .WillOnce(Return(modbus::ExceptionCode::kSlaveDeviceBusy));
+  RequestNoResponse(request, sizeof(request));
+}
+
+TEST_F(ModbusTest, ReadInputRegisterBroadcast) {
+  const uint8_t request[] = {
+      0x00,        // Broadcast address
+      0x04,        // Function code
+      0x45, 0x67,  // Starting Address
+      0x00, 0x01,  // Quantity of Input Registers
+  };
+
+  EXPECT_CALL(data_, Start(_, _)).Times(0);
+  EXPECT_CALL(data_, ReadRegister(_, _)).Times(0);
+  RequestNoResponse(request, sizeof(request));
+}
+
 TEST_F(ModbusTest, MultipleRequests) {
   const uint8_t request[] = {
       0x01,        // Slave address
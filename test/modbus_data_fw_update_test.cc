@@ -3,41 +3,14 @@
 #include <algorithm>
 #include <array>
 #include <numeric>
+#include <vector>
 
+#include "boot/recovery.h"
+#include "fake_bootloader.h"
 #include "modbus_data_fw_update.h"
 
 namespace {
 
-class FakeBootloader final : public BootloaderInterface {
- public:
-  static constexpr size_t kMemorySize = 4 * 1024;
-
-  bool PrepareUpdate() override {
-    prepared = true;
-    return true;
-  }
-
-  bool WriteImageData(size_t offset, uint8_t* data, size_t length) override {
-    if (!prepared) {
-      return false;
-    }
-
-    auto end = std::copy_n(data, length, update_memory.begin() + offset);
-    return end == update_memory.begin() + length;
-  }
-
-  bool SetUpdatePending() override {
-    pending = true;
-    return true;
-  }
-
-  bool SetUpdateConfirmed() override { return true; }
-
-  std::array<uint8_t, kMemorySize> update_memory;
-  bool prepared = false;
-  bool pending = false;
-};
-
 TEST(ModbusDataFwUpdateTest, good_update_sequence) {
   std::array<uint8_t, FakeBootloader::kMemorySize> image_data;
 
@@ -55,7 +28,12 @@ TEST(ModbusDataFwUpdateTest, good_update_sequence) {
   for (size_t i = 0; i < image_data.size(); i += 2) {
     uint16_t data = image_data[i] << 8 | image_data[i + 1];
     EXPECT_EQ(fw_update.WriteRegister(i / 2, data), modbus::ExceptionCode::kOk);
+    fw_update.WritePending();
   }
+  bl.hashed_length = kActualImageSize;
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kOk);
   EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
                                     ModbusDataFwUpdate::Command::kSetPending),
             modbus::ExceptionCode::kOk);
@@ -65,4 +43,534 @@ TEST(ModbusDataFwUpdateTest, good_update_sequence) {
   EXPECT_EQ(bl.pending, true);
 }
 
+TEST(ModbusDataFwUpdateTest, receives_while_writing) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 0; i < 256; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, 0xABCD), modbus::ExceptionCode::kOk);
+  }
+  EXPECT_TRUE(fw_update.write_pending());
+
+  // The second block fills while the first one waits to be written.
+  for (size_t i = 256; i < 512; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, 0x1234), modbus::ExceptionCode::kOk);
+  }
+  EXPECT_EQ(fw_update.WriteRegister(512, 0xABCD),
+            modbus::ExceptionCode::kSlaveDeviceBusy);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kSlaveDeviceBusy);
+
+  fw_update.WritePending();
+  EXPECT_TRUE(fw_update.write_pending());
+  EXPECT_EQ(bl.update_memory[0], 0xAB);
+  EXPECT_EQ(bl.update_memory[511], 0xCD);
+
+  fw_update.WritePending();
+  EXPECT_FALSE(fw_update.write_pending());
+  EXPECT_EQ(bl.update_memory[512], 0x12);
+  EXPECT_EQ(bl.update_memory[1023], 0x34);
+  EXPECT_EQ(fw_update.WriteRegister(512, 0xABCD), modbus::ExceptionCode::kOk);
+}
+
+TEST(ModbusDataFwUpdateTest, rejects_blocks_past_the_slot) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+
+  // The fake slot holds 8 blocks of 256 words.
+  constexpr uint16_t kSlotWords = FakeBootloader::kMemorySize / 2;
+  EXPECT_EQ(fw_update.WriteRegister(kSlotWords - 1, 0xABCD),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(kSlotWords, 0xABCD),
+            modbus::ExceptionCode::kIllegalDataAddress);
+  EXPECT_EQ(fw_update.WriteFileRecord(ModbusDataFwUpdate::kImageFile,
+                                      kSlotWords, 0xABCD),
+            modbus::ExceptionCode::kIllegalDataAddress);
+}
+
+TEST(ModbusDataFwUpdateTest, out_of_order_blocks) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+
+  // Second block backwards, then the first block.
+  for (size_t i = 512; i > 256; i--) {
+    EXPECT_EQ(fw_update.WriteRegister(i - 1, i - 1),
+              modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+  for (size_t i = 0; i < 256; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, i), modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+
+  for (size_t i = 0; i < 512; i++) {
+    EXPECT_EQ(bl.update_memory[2 * i], i >> 8);
+    EXPECT_EQ(bl.update_memory[2 * i + 1], i & 0xFF);
+  }
+}
+
+TEST(ModbusDataFwUpdateTest, ignores_repeated_blocks) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 0; i < 256; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, 0xABCD), modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+
+  EXPECT_EQ(fw_update.WriteRegister(0, 0x1234), modbus::ExceptionCode::kOk);
+  EXPECT_FALSE(fw_update.write_pending());
+  EXPECT_EQ(bl.update_memory[0], 0xAB);
+}
+
+TEST(ModbusDataFwUpdateTest, received_block_bitmap) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 2 * 256; i < 3 * 256; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, 0), modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+  EXPECT_EQ(fw_update.received_blocks(), 0b100u);
+
+  uint16_t high, low;
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kBlockBitmapRegister,
+                                   &high),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.ReadRegister(
+                ModbusDataFwUpdate::kBlockBitmapRegister + 1, &low),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(high, 0);
+  EXPECT_EQ(low, 0b100);
+
+  // Blocks 0 and 1 are missing.
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kIllegalDataValue);
+  EXPECT_FALSE(bl.pending);
+}
+
+TEST(ModbusDataFwUpdateTest, busy_with_two_incomplete_blocks) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(0, 0), modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(256, 0), modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(512, 0),
+            modbus::ExceptionCode::kSlaveDeviceBusy);
+
+  // Only the last block may be incomplete.
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kIllegalDataValue);
+}
+
+TEST(ModbusDataFwUpdateTest, pads_last_block) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 0; i < 300; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, 0), modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+  bl.hashed_length = 600;
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kOk);
+
+  EXPECT_TRUE(bl.pending);
+  EXPECT_EQ(bl.update_memory[599], 0);
+  EXPECT_EQ(bl.update_memory[600], 0xFF);
+  EXPECT_EQ(bl.update_memory[1023], 0xFF);
+}
+
+TEST(ModbusDataFwUpdateTest, digest_registers) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 0; i < 256; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, 0), modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+
+  uint16_t value = 0xFFFF;
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kDigestRegister,
+                                   &value),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(value, 0);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kIllegalDataValue);
+
+  bl.hashed_length = 1234;
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kHashedLengthRegister,
+                                   &value),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(value, 1234);
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kDigestRegister + 1,
+                                   &value),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(value, 0x0203);
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kDigestRegister + 15,
+                                   &value),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(value, 0x1E1F);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kOk);
+}
+
+TEST(ModbusDataFwUpdateTest, set_pending_requires_verify) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 0; i < 256; i++) {
+    EXPECT_EQ(fw_update.WriteRegister(i, 0), modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kIllegalDataValue);
+
+  // Failed verification.
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kIllegalDataValue);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kIllegalDataValue);
+
+  // A write after the verification needs another one.
+  bl.hashed_length = 512;
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(256, 0), modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kIllegalDataValue);
+  EXPECT_FALSE(bl.pending);
+
+  // Verifying writes the incomplete last block.
+  bl.hashed_length = 514;
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.received_blocks(), 0b11u);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kOk);
+  EXPECT_TRUE(bl.pending);
+
+  // The prepare command discards the verification.
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kIllegalDataValue);
+}
+
+TEST(ModbusDataFwUpdateTest, crc_range_query) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCrcOffsetRegister,
+                                    0x200),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCrcLengthRegister,
+                                    0x100),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kCrc),
+            modbus::ExceptionCode::kOk);
+
+  uint16_t high, low;
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kCrcRegister, &high),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kCrcRegister + 1, &low),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(high, 0x200);
+  EXPECT_EQ(low, 0x100);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCrcLengthRegister,
+                                    0x1000),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kCrc),
+            modbus::ExceptionCode::kIllegalDataValue);
+}
+
+TEST(ModbusDataFwUpdateTest, compressed_stream) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  // 0x1234 repeated 1024 times: Two literals, then matches at distance 2.
+  const std::vector<uint8_t> stream = {
+      0b11, 0x12, 0x34, 1, 255, 1, 255, 1, 255, 1, 255, 1, 255, 1, 255,
+      0b00, 1, 255, 1, 237,
+  };
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 0; i < stream.size(); i += 2) {
+    uint16_t data = stream[i] << 8 | stream[i + 1];
+    uint16_t address = ModbusDataFwUpdate::kStreamRegister + i / 2;
+    EXPECT_EQ(fw_update.WriteRegister(address, data),
+              modbus::ExceptionCode::kOk);
+    // Repeated word.
+    EXPECT_EQ(fw_update.WriteRegister(address, data),
+              modbus::ExceptionCode::kOk);
+  }
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kStreamRegister + 11,
+                                    0),
+            modbus::ExceptionCode::kIllegalDataAddress);
+
+  uint16_t words;
+  EXPECT_EQ(fw_update.ReadRegister(ModbusDataFwUpdate::kStreamOffsetRegister,
+                                   &words),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(words, stream.size() / 2);
+
+  // Writing a block makes room for the next one.
+  while (fw_update.write_pending()) {
+    fw_update.WritePending();
+  }
+  EXPECT_EQ(fw_update.received_blocks(), 0b1111u);
+  bl.hashed_length = 2048;
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kVerify),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kSetPending),
+            modbus::ExceptionCode::kOk);
+
+  for (size_t i = 0; i < 2048; i += 2) {
+    EXPECT_EQ(bl.update_memory[i], 0x12);
+    EXPECT_EQ(bl.update_memory[i + 1], 0x34);
+  }
+}
+
+TEST(ModbusDataFwUpdateTest, compressed_stream_busy) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+
+  // Uncompressible data: Groups of a flag byte and eight literals.
+  size_t word = 0;
+  modbus::ExceptionCode result;
+  do {
+    uint16_t address = ModbusDataFwUpdate::kStreamRegister + word;
+    uint16_t data = (2 * word) % 9 == 0 ? 0xFF00 : 0x0000;
+    data |= (2 * word + 1) % 9 == 0 ? 0xFF : 0x00;
+    result = fw_update.WriteRegister(address, data);
+  } while (result == modbus::ExceptionCode::kOk && ++word < 1024);
+
+  // Two blocks decompressed and the input buffer filled.
+  EXPECT_EQ(result, modbus::ExceptionCode::kSlaveDeviceBusy);
+  EXPECT_EQ(word, (2 * 9 * ModbusDataFwUpdate::kBlockSize / 8 +
+                   LzDecoder::kInputSize) / 2);
+
+  fw_update.WritePending();
+  EXPECT_EQ(fw_update.received_blocks(), 0b1u);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kStreamRegister + word,
+                                    0),
+            modbus::ExceptionCode::kOk);
+}
+
+TEST(ModbusDataFwUpdateTest, delta_update) {
+  FakeBootloader bl;
+  bl.running_image.resize(1024);
+  std::iota(bl.running_image.begin(), bl.running_image.end(), 0);
+  ModbusDataFwUpdate fw_update(bl);
+
+  // Replaces the first byte of the running image. The patch is not compressed:
+  // Every flag byte marks eight literals.
+  std::vector<uint8_t> patch = {'S', 'S', 'U', 'P'};
+  patch.insert(patch.end(), bl.running_digest.begin(),
+               bl.running_digest.end());
+  patch.insert(patch.end(), {DeltaPatch::kInsert, 1, 0, 0xAB,
+                             DeltaPatch::kCopy, 1, 0, 0xFF, 0x03, 0});
+  std::vector<uint8_t> stream;
+  for (size_t i = 0; i < patch.size(); i++) {
+    if (i % 8 == 0) {
+      stream.push_back(0xFF);
+    }
+    stream.push_back(patch[i]);
+  }
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepareDelta),
+            modbus::ExceptionCode::kOk);
+  for (size_t i = 0; i < stream.size(); i += 2) {
+    uint16_t data = stream[i] << 8 | stream[i + 1];
+    uint16_t address = ModbusDataFwUpdate::kStreamRegister + i / 2;
+    EXPECT_EQ(fw_update.WriteRegister(address, data),
+              modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+  fw_update.WritePending();
+  EXPECT_EQ(fw_update.received_blocks(), 0b11u);
+
+  EXPECT_EQ(bl.update_memory[0], 0xAB);
+  for (size_t i = 1; i < 1024; i++) {
+    EXPECT_EQ(bl.update_memory[i], i & 0xFF);
+  }
+}
+
+TEST(ModbusDataFwUpdateTest, delta_update_wrong_base) {
+  FakeBootloader bl;
+  bl.running_digest[0] = 1;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepareDelta),
+            modbus::ExceptionCode::kOk);
+
+  // Flag byte, magic and an all zero digest.
+  std::vector<uint8_t> stream = {0xFF, 'S', 'S', 'U', 'P'};
+  stream.resize(42);
+  for (size_t i = 9; i < stream.size(); i += 9) {
+    stream[i] = 0xFF;
+  }
+
+  modbus::ExceptionCode result = modbus::ExceptionCode::kOk;
+  for (size_t i = 0; i < stream.size(); i += 2) {
+    uint16_t data = stream[i] << 8 | stream[i + 1];
+    result = fw_update.WriteRegister(
+        ModbusDataFwUpdate::kStreamRegister + i / 2, data);
+  }
+  EXPECT_EQ(result, modbus::ExceptionCode::kIllegalDataValue);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kStreamRegister + 21,
+                                    0),
+            modbus::ExceptionCode::kIllegalDataValue);
+}
+
+TEST(ModbusDataFwUpdateTest, broadcast_replaces_incomplete_block) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  fw_update.Start(modbus::FunctionCode::kWriteMultipleRegisters, true);
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+
+  // The first word of every block was lost.
+  for (size_t i = 0; i < 4 * 256; i++) {
+    if (i % 256 != 0) {
+      EXPECT_EQ(fw_update.WriteRegister(i, 0x1234),
+                modbus::ExceptionCode::kOk);
+    }
+  }
+  EXPECT_FALSE(fw_update.write_pending());
+  EXPECT_EQ(fw_update.received_blocks(), 0u);
+
+  uint16_t evicted;
+  EXPECT_EQ(fw_update.ReadRegister(
+                ModbusDataFwUpdate::kEvictedBlocksRegister, &evicted),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(evicted, 2);
+
+  // Repair by unicast: Blocks 0 and 1 were dropped and must be sent again.
+  fw_update.Start(modbus::FunctionCode::kWriteSingleRegister, false);
+  EXPECT_EQ(fw_update.WriteRegister(2 * 256, 0x1234),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.WriteRegister(3 * 256, 0x1234),
+            modbus::ExceptionCode::kOk);
+  fw_update.WritePending();
+  fw_update.WritePending();
+  EXPECT_EQ(fw_update.received_blocks(), 0b1100u);
+  EXPECT_EQ(fw_update.WriteRegister(0, 0x1234), modbus::ExceptionCode::kOk);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(fw_update.ReadRegister(
+                ModbusDataFwUpdate::kEvictedBlocksRegister, &evicted),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(evicted, 0);
+}
+
+TEST(ModbusDataFwUpdateTest, file_records) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  EXPECT_EQ(fw_update.WriteRegister(ModbusDataFwUpdate::kCommandRegister,
+                                    ModbusDataFwUpdate::Command::kPrepare),
+            modbus::ExceptionCode::kOk);
+  for (uint16_t record = 0; record < 256; record++) {
+    EXPECT_EQ(fw_update.WriteFileRecord(ModbusDataFwUpdate::kImageFile,
+                                        record, record),
+              modbus::ExceptionCode::kOk);
+  }
+  fw_update.WritePending();
+  EXPECT_EQ(fw_update.received_blocks(), 0b1u);
+
+  uint16_t data;
+  EXPECT_EQ(fw_update.ReadFileRecord(ModbusDataFwUpdate::kImageFile, 0x12,
+                                     &data),
+            modbus::ExceptionCode::kOk);
+  EXPECT_EQ(data, 0x12);
+  EXPECT_EQ(fw_update.ReadFileRecord(ModbusDataFwUpdate::kImageFile, 2048,
+                                     &data),
+            modbus::ExceptionCode::kIllegalDataAddress);
+  EXPECT_EQ(fw_update.ReadFileRecord(ModbusDataFwUpdate::kStreamFile, 0,
+                                     &data),
+            modbus::ExceptionCode::kIllegalDataAddress);
+
+  // The stream is written without gaps.
+  EXPECT_EQ(fw_update.WriteFileRecord(ModbusDataFwUpdate::kStreamFile, 1, 0),
+            modbus::ExceptionCode::kIllegalDataAddress);
+  EXPECT_EQ(fw_update.WriteFileRecord(3, 0, 0),
+            modbus::ExceptionCode::kIllegalDataAddress);
+}
+
+// Masters tell the recovery mode from the firmware by this register.
+TEST(ModbusDataFwUpdateTest, rejects_recovery_register) {
+  FakeBootloader bl;
+  ModbusDataFwUpdate fw_update(bl);
+
+  uint16_t data;
+  EXPECT_EQ(fw_update.ReadRegister(RecoveryData::kRecoveryRegister - 0x8000,
+                                   &data),
+            modbus::ExceptionCode::kIllegalDataAddress);
+}
+
 }  // namespace
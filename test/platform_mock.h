@@ -0,0 +1,31 @@
+#ifndef PLATFORM_MOCK_H_
+#define PLATFORM_MOCK_H_
+
+#include "gmock/gmock.h"
+
+#include "platform_interface.h"
+
+class PlatformMock : public PlatformInterface {
+ public:
+  PlatformMock() {
+    ON_CALL(*this, Now()).WillByDefault(
+        ::testing::Invoke([this]() { return now; }));
+    ON_CALL(*this, DeepestSleepMode())
+        .WillByDefault(::testing::Return(SleepMode::kDeepSleep));
+    ON_CALL(*this, WakeupLatencyMs(SleepMode::kSleep))
+        .WillByDefault(::testing::Return(0));
+    ON_CALL(*this, WakeupLatencyMs(SleepMode::kDeepSleep))
+        .WillByDefault(::testing::Return(2));
+  }
+
+  MOCK_METHOD0(Now, uint32_t());
+  MOCK_METHOD0(DeepestSleepMode, SleepMode());
+  MOCK_METHOD1(WakeupLatencyMs, uint32_t(SleepMode mode));
+  MOCK_METHOD2(Sleep, void(SleepMode mode, uint32_t timeout_ms));
+  MOCK_METHOD0(DisableInterrupts, void());
+  MOCK_METHOD0(EnableInterrupts, void());
+
+  uint32_t now = 0;
+};
+
+#endif  // PLATFORM_MOCK_H_
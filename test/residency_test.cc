@@ -0,0 +1,69 @@
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "platform_mock.h"
+#include "residency.h"
+
+using ::testing::NiceMock;
+
+class ResidencyTest : public ::testing::Test {
+ protected:
+  ResidencyTest() : residency_(platform_) {}
+
+  NiceMock<PlatformMock> platform_;
+  Residency residency_;
+};
+
+TEST_F(ResidencyTest, StartsActive) {
+  platform_.now = 7;
+  EXPECT_EQ(residency_.Total(Residency::kActive), 7u);
+  EXPECT_EQ(residency_.Total(Residency::kSleep), 0u);
+}
+
+TEST_F(ResidencyTest, AccountsStateChanges) {
+  platform_.now = 10;
+  EXPECT_EQ(residency_.Enter(Residency::kMeasure), Residency::kActive);
+  platform_.now = 25;
+  EXPECT_EQ(residency_.Enter(Residency::kActive), Residency::kMeasure);
+  platform_.now = 30;
+  residency_.Enter(Residency::kSleep);
+  platform_.now = 100;
+
+  EXPECT_EQ(residency_.Total(Residency::kActive), 15u);
+  EXPECT_EQ(residency_.Total(Residency::kMeasure), 15u);
+  EXPECT_EQ(residency_.Total(Residency::kSleep), 70u);
+  EXPECT_EQ(residency_.Total(Residency::kDeepSleep), 0u);
+}
+
+TEST_F(ResidencyTest, TransmitOverlapsCpuStates) {
+  platform_.now = 10;
+  residency_.StartTransmit();
+  residency_.Enter(Residency::kSleep);
+  platform_.now = 14;
+  EXPECT_EQ(residency_.Total(Residency::kTransmit), 4u);
+  platform_.now = 20;
+  residency_.StopTransmit();
+  platform_.now = 50;
+
+  EXPECT_EQ(residency_.Total(Residency::kTransmit), 10u);
+  EXPECT_EQ(residency_.Total(Residency::kActive), 10u);
+  EXPECT_EQ(residency_.Total(Residency::kSleep), 40u);
+}
+
+TEST_F(ResidencyTest, ResetKeepsCurrentState) {
+  residency_.Enter(Residency::kDeepSleep);
+  platform_.now = 100;
+  residency_.Reset();
+  platform_.now = 120;
+
+  EXPECT_EQ(residency_.Total(Residency::kActive), 0u);
+  EXPECT_EQ(residency_.Total(Residency::kDeepSleep), 20u);
+}
+
+TEST_F(ResidencyTest, CountsAcrossTimeWrapAround) {
+  platform_.now = UINT32_MAX - 4;
+  residency_.Reset();
+  residency_.Enter(Residency::kSleep);
+  platform_.now = 5;
+  EXPECT_EQ(residency_.Total(Residency::kSleep), 10u);
+}
@@ -0,0 +1,146 @@
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "platform_mock.h"
+#include "scheduler.h"
+
+using ::testing::_;
+using ::testing::InSequence;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+
+class SchedulerTest : public ::testing::Test {
+ protected:
+  enum TaskId { kTaskA, kTaskB, kNumTasks };
+
+  SchedulerTest()
+      : tasks_{{Run, &runs_[kTaskA]}, {Run, &runs_[kTaskB]}},
+        scheduler_(platform_, tasks_, kNumTasks) {}
+
+  static void Run(Scheduler &, void *context) {
+    (*static_cast<int *>(context))++;
+  }
+
+  NiceMock<PlatformMock> platform_;
+  int runs_[kNumTasks] = {};
+  const Scheduler::Task tasks_[kNumTasks];
+  Scheduler scheduler_;
+};
+
+TEST_F(SchedulerTest, SleepsWithoutTimeout) {
+  EXPECT_CALL(platform_, Sleep(SleepMode::kDeepSleep, Scheduler::kNoTimeout));
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 0);
+  EXPECT_EQ(runs_[kTaskB], 0);
+}
+
+TEST_F(SchedulerTest, RunsPostedTasksOnce) {
+  scheduler_.Post(kTaskB);
+  scheduler_.Post(kTaskB);
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 0);
+  EXPECT_EQ(runs_[kTaskB], 1);
+
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskB], 1);
+}
+
+TEST_F(SchedulerTest, SleepsWithInterruptsDisabled) {
+  InSequence s;
+  EXPECT_CALL(platform_, DisableInterrupts());
+  EXPECT_CALL(platform_, Sleep(_, _));
+  EXPECT_CALL(platform_, EnableInterrupts());
+  scheduler_.RunOnce();
+}
+
+TEST_F(SchedulerTest, DoesNotSleepWhenPostedDuringRun) {
+  const Scheduler::Task tasks[] = {
+      {[](Scheduler &s, void *) { s.Post(0); }, nullptr},
+  };
+  Scheduler scheduler(platform_, tasks, 1);
+  scheduler.Post(0);
+
+  EXPECT_CALL(platform_, Sleep(_, _)).Times(0);
+  scheduler.RunOnce();
+}
+
+TEST_F(SchedulerTest, RunsTaskAtDeadline) {
+  platform_.now = 1000;
+  scheduler_.PostAfter(kTaskA, 100);
+
+  // Wakes up early enough to cover the wakeup latency.
+  EXPECT_CALL(platform_, Sleep(SleepMode::kDeepSleep, 98));
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 0);
+
+  platform_.now = 1099;
+  EXPECT_CALL(platform_, Sleep(SleepMode::kSleep, 1));
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 0);
+
+  platform_.now = 1100;
+  EXPECT_CALL(platform_, Sleep(_, Scheduler::kNoTimeout));
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 1);
+}
+
+TEST_F(SchedulerTest, SleepsUntilNearestDeadline) {
+  scheduler_.PostAfter(kTaskA, 500);
+  scheduler_.PostAfter(kTaskB, 50);
+  EXPECT_CALL(platform_, Sleep(SleepMode::kDeepSleep, 48));
+  scheduler_.RunOnce();
+}
+
+TEST_F(SchedulerTest, LightSleepWhenDeadlineTooClose) {
+  scheduler_.PostAfter(kTaskA, 2);
+  EXPECT_CALL(platform_, Sleep(SleepMode::kSleep, 2));
+  scheduler_.RunOnce();
+}
+
+TEST_F(SchedulerTest, RespectsDeepestAllowedSleepMode) {
+  ON_CALL(platform_, DeepestSleepMode())
+      .WillByDefault(Return(SleepMode::kSleep));
+  scheduler_.PostAfter(kTaskA, 100);
+  EXPECT_CALL(platform_, Sleep(SleepMode::kSleep, 100));
+  scheduler_.RunOnce();
+}
+
+TEST_F(SchedulerTest, CancelRemovesDeadline) {
+  scheduler_.PostAfter(kTaskA, 10);
+  scheduler_.Cancel(kTaskA);
+  platform_.now = 20;
+  EXPECT_CALL(platform_, Sleep(_, Scheduler::kNoTimeout));
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 0);
+}
+
+TEST_F(SchedulerTest, DeadlineAcrossTimeWrapAround) {
+  platform_.now = UINT32_MAX - 10;
+  scheduler_.PostAfter(kTaskA, 20);
+
+  platform_.now = 5;
+  EXPECT_CALL(platform_, Sleep(SleepMode::kDeepSleep, 2));
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 0);
+
+  platform_.now = 9;
+  EXPECT_CALL(platform_, Sleep(_, Scheduler::kNoTimeout));
+  scheduler_.RunOnce();
+  EXPECT_EQ(runs_[kTaskA], 1);
+}
+
+TEST_F(SchedulerTest, AccountsSleepResidency) {
+  Residency residency(platform_);
+  scheduler_.set_residency(&residency);
+  scheduler_.PostAfter(kTaskA, 10);
+
+  platform_.now = 3;
+  EXPECT_CALL(platform_, Sleep(SleepMode::kDeepSleep, _))
+      .WillOnce(Invoke([this](SleepMode, uint32_t) { platform_.now = 8; }));
+  scheduler_.RunOnce();
+
+  EXPECT_EQ(residency.Total(Residency::kActive), 3u);
+  EXPECT_EQ(residency.Total(Residency::kDeepSleep), 5u);
+  EXPECT_EQ(residency.Total(Residency::kSleep), 0u);
+}
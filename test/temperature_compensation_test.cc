@@ -0,0 +1,53 @@
+#include "gtest/gtest.h"
+
+#include "temperature_compensation.h"
+
+namespace {
+
+// Typical diode: -2mV/°C, 0.8mV per ADC count -> -0.4°C per count.
+// Sensor: Raw value rises by 3 counts per °C.
+constexpr TemperatureCompensation kCompensation = {
+    1500,                // diode_ref
+    2500,                // temperature_ref: 25.00°C
+    -40 * 256,           // temperature_slope: -0.40°C per count
+    3 * 65536 / 100,     // raw_slope: 0.03 counts per 0.01°C
+};
+
+TEST(TemperatureCompensationTest, Disabled) {
+  TemperatureCompensation tc = {};
+  EXPECT_FALSE(tc.IsEnabled());
+  EXPECT_EQ(tc.Temperature(1234), TemperatureCompensation::kInvalidTemperature);
+  EXPECT_EQ(tc.Apply(1234, 2500), 1234);
+}
+
+TEST(TemperatureCompensationTest, Temperature) {
+  EXPECT_EQ(kCompensation.Temperature(1500), 2500);
+  EXPECT_EQ(kCompensation.Temperature(1450), 4500);
+  EXPECT_EQ(kCompensation.Temperature(1550), 500);
+  EXPECT_EQ(kCompensation.Temperature(1600), -1500);
+}
+
+TEST(TemperatureCompensationTest, TemperatureSaturates) {
+  TemperatureCompensation tc = kCompensation;
+  tc.temperature_slope = INT16_MIN;
+  EXPECT_EQ(tc.Temperature(0), INT16_MAX);
+  EXPECT_EQ(tc.Temperature(0xFFFF), INT16_MIN + 1);
+}
+
+TEST(TemperatureCompensationTest, Apply) {
+  EXPECT_EQ(kCompensation.Apply(2000, 2500), 2000);
+  EXPECT_EQ(kCompensation.Apply(2000, 3500), 1970);
+  EXPECT_EQ(kCompensation.Apply(2000, 1500), 2030);
+
+  // Diode reading and correction combined.
+  EXPECT_EQ(kCompensation.Apply(2000, kCompensation.Temperature(1450)), 1940);
+}
+
+TEST(TemperatureCompensationTest, ApplySaturates) {
+  TemperatureCompensation tc = kCompensation;
+  tc.raw_slope = INT16_MAX;
+  EXPECT_EQ(tc.Apply(10, INT16_MAX), 0);
+  EXPECT_EQ(tc.Apply(0xFFF0, INT16_MIN + 1), UINT16_MAX);
+}
+
+}  // namespace
@@ -0,0 +1,65 @@
+#include "gtest/gtest.h"
+
+#include "threshold_alarms.h"
+
+namespace {
+
+using Range = ThresholdAlarms::Range;
+
+TEST(ThresholdAlarmsTest, Latch) {
+  ThresholdAlarms alarms;
+  alarms.Latch(Range::kInside);
+  EXPECT_EQ(alarms.flags(), 0);
+
+  alarms.Latch(Range::kBelow);
+  EXPECT_EQ(alarms.flags(), kAlarmBelowLow);
+
+  // Stays latched when the value returns into the thresholds.
+  alarms.Latch(Range::kInside);
+  alarms.Latch(Range::kAbove);
+  EXPECT_EQ(alarms.flags(), kAlarmBelowLow | kAlarmAboveHigh);
+
+  alarms.Clear();
+  EXPECT_EQ(alarms.flags(), 0);
+}
+
+TEST(ThresholdAlarmsTest, SweepKeepsAlarmState) {
+  ThresholdAlarms alarms;
+  alarms.Latch(Range::kBelow);
+
+  // Points of a sweep, the normal excitation first and in between.
+  const uint16_t reloads[] = {ThresholdAlarms::kNormalPwmReload, 1, 3,
+                              ThresholdAlarms::kNormalPwmReload, 7};
+  const Range ranges[] = {Range::kInside, Range::kAbove, Range::kAbove,
+                          Range::kInside, Range::kAbove};
+  for (size_t i = 0; i < 5; i++) {
+    alarms.SelectPwmReload(reloads[i]);
+    alarms.Latch(ranges[i]);
+  }
+  alarms.SelectPwmReload(ThresholdAlarms::kNormalPwmReload);
+
+  EXPECT_EQ(alarms.flags(), kAlarmBelowLow);
+  EXPECT_TRUE(alarms.armed());
+
+  // The background measurement latches again after the sweep.
+  alarms.Latch(Range::kAbove);
+  EXPECT_EQ(alarms.flags(), kAlarmBelowLow | kAlarmAboveHigh);
+}
+
+TEST(ThresholdAlarmsTest, CaptureKeepsAlarmState) {
+  ThresholdAlarms alarms;
+
+  // The capture starts with the normal excitation but records the settling.
+  alarms.Suspend();
+  alarms.Latch(Range::kBelow);
+  alarms.Latch(Range::kAbove);
+  alarms.Resume();
+
+  EXPECT_EQ(alarms.flags(), 0);
+  EXPECT_TRUE(alarms.armed());
+
+  alarms.Latch(Range::kBelow);
+  EXPECT_EQ(alarms.flags(), kAlarmBelowLow);
+}
+
+}  // namespace